@@ -0,0 +1,3048 @@
+/*
+gmatool - reading, extracting and merging GMA and TPL files.
+*/
+#pragma once
+#include <iostream>
+#include <fstream>
+#include <string>
+#include <cstring>
+#include <cctype>
+#include <algorithm>
+#include <iterator>
+#include <string_view>
+#include <unordered_map>
+#include <unordered_set>
+#include <vector>
+#include <atomic>
+#include <thread>
+#include <mutex>
+#include <functional>
+#include <memory>
+#include <regex>
+#include <filesystem>
+#include <chrono>
+#include <cerrno>
+#include <fcntl.h>
+#include <sys/stat.h>
+#ifdef _WIN32
+#define NOMINMAX
+#include <windows.h>
+#include <io.h>
+#else
+#include <sys/mman.h>
+#include <unistd.h>
+#endif
+#ifdef __linux__
+#include <sys/sendfile.h>
+#include <sys/inotify.h>
+#include <poll.h>
+#endif
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#define GMATOOL_SSE2
+#include <emmintrin.h>
+#endif
+
+namespace gmatool {
+
+/*
+Counters and phase timers for --stats, shared by every thread.
+Counters are always kept, as they're cheap next to the I/O they count, but phases are only timed when --stats is on.
+A phase started inside another one pauses it, so each moment is only counted once. With -j, phase times are added up across threads and can be more than the wall time.
+*/
+enum StatsPhase {indexphase, headerphase, remapphase, copyphase, tplphase, phaseamount};
+const char* const phasenames[phaseamount] = {"index build", "header emit", "material remap", "data copy", "TPL rebuild"};
+
+struct RunStats {
+	bool istiming = false;
+	std::atomic<uint64_t> phasenanoseconds[phaseamount];
+	std::atomic<uint64_t> filesopened{0};
+	std::atomic<uint64_t> bytesmapped{0};
+	std::atomic<uint64_t> reads{0};
+	std::atomic<uint64_t> bytesread{0};
+	std::atomic<uint64_t> writes{0};
+	std::atomic<uint64_t> byteswritten{0};
+	std::atomic<uint64_t> kernelcopies{0};
+	std::atomic<uint64_t> bytescopied{0};
+	std::atomic<uint64_t> seeks{0};
+};
+
+inline RunStats runstats;
+
+class PhaseTimer {
+	public:
+	PhaseTimer(StatsPhase phase) : phase(phase) {
+		if (runstats.istiming == false){
+			return;
+		}
+		parent = activetimer;
+		if (parent != nullptr){
+			parent->pause();
+		}
+		activetimer = this;
+		starttime = std::chrono::steady_clock::now();
+	}
+	~PhaseTimer(){
+		if (runstats.istiming == false){
+			return;
+		}
+		pause();
+		activetimer = parent;
+		if (parent != nullptr){
+			parent->starttime = std::chrono::steady_clock::now();
+		}
+	}
+	PhaseTimer(const PhaseTimer&) = delete;
+	PhaseTimer& operator=(const PhaseTimer&) = delete;
+	//moves on to the next phase without starting another timer
+	void switchTo(StatsPhase nextphase){
+		if (runstats.istiming){
+			pause();
+			starttime = std::chrono::steady_clock::now();
+		}
+		phase = nextphase;
+	}
+	private:
+	void pause(){
+		runstats.phasenanoseconds[phase] += std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now() - starttime).count();
+	}
+	StatsPhase phase;
+	PhaseTimer* parent = nullptr;
+	std::chrono::steady_clock::time_point starttime;
+	static inline thread_local PhaseTimer* activetimer = nullptr;
+};
+
+/*
+A read-only view of a whole GMA or TPL file.
+The file is mapped into memory once when it's opened, so every pluck afterwards is a plain memory read.
+Bytes that are already in memory can be viewed the same way with openBuffer, which never copies them.
+Plucks are bounds-checked: anything past the end of the file reads as 0 and marks the view as overrun.
+*/
+class MappedFile {
+	public:
+	MappedFile(){}
+	~MappedFile(){
+		close();
+	}
+	MappedFile(const MappedFile&) = delete;
+	MappedFile& operator=(const MappedFile&) = delete;
+	bool open(std::string filename);
+	//the bytes have to stay where they are until this is closed
+	bool openBuffer(const unsigned char* bytes, uint64_t length);
+	void close();
+	bool good() const {
+		return isopen;
+	}
+	uint64_t length() const {
+		return filelength;
+	}
+	const unsigned char* data() const {
+		return filedata;
+	}
+	bool inBounds(uint64_t offset, uint64_t size) const {
+		return offset <= filelength && size <= filelength - offset;
+	}
+	bool overrun() const {
+		return hasoverrun;
+	}
+	void markOverrun() const {
+		hasoverrun = true;
+	}
+	uint32_t intPluck(uint64_t offset) const;
+	uint16_t shortPluck(uint64_t offset) const;
+	#ifndef _WIN32
+	int descriptor() const {
+		return filedescriptor;
+	}
+	#endif
+	private:
+	const unsigned char* filedata = nullptr;
+	uint64_t filelength = 0;
+	bool isopen = false;
+	bool isinmemory = false;
+	mutable std::atomic<bool> hasoverrun{false};
+	#ifdef _WIN32
+	HANDLE filehandle = INVALID_HANDLE_VALUE;
+	HANDLE maphandle = NULL;
+	#else
+	int filedescriptor = -1;
+	#endif
+};
+
+inline bool MappedFile::open(std::string filename){
+	close();
+	#ifdef _WIN32
+	filehandle = CreateFileA(filename.c_str(), GENERIC_READ, FILE_SHARE_READ | FILE_SHARE_WRITE, NULL, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, NULL);
+	if (filehandle == INVALID_HANDLE_VALUE){
+		return false;
+	}
+	LARGE_INTEGER filesize;
+	if (GetFileSizeEx(filehandle, &filesize) == 0){
+		close();
+		return false;
+	}
+	filelength = filesize.QuadPart;
+	//empty files can't be mapped, but they're still valid (and empty) views
+	if (filelength > 0){
+		maphandle = CreateFileMappingA(filehandle, NULL, PAGE_READONLY, 0, 0, NULL);
+		if (maphandle == NULL){
+			close();
+			return false;
+		}
+		filedata = reinterpret_cast<const unsigned char*>(MapViewOfFile(maphandle, FILE_MAP_READ, 0, 0, 0));
+		if (filedata == NULL){
+			close();
+			return false;
+		}
+	}
+	#else
+	filedescriptor = ::open(filename.c_str(), O_RDONLY);
+	if (filedescriptor < 0){
+		return false;
+	}
+	struct stat filestat;
+	if (fstat(filedescriptor, &filestat) != 0 || S_ISREG(filestat.st_mode) == false){
+		close();
+		return false;
+	}
+	filelength = filestat.st_size;
+	//empty files can't be mapped, but they're still valid (and empty) views
+	if (filelength > 0){
+		void* mapping = mmap(NULL, filelength, PROT_READ, MAP_PRIVATE, filedescriptor, 0);
+		if (mapping == MAP_FAILED){
+			close();
+			return false;
+		}
+		filedata = reinterpret_cast<const unsigned char*>(mapping);
+	}
+	#endif
+	runstats.filesopened++;
+	runstats.bytesmapped += filelength;
+	isopen = true;
+	return true;
+}
+
+inline bool MappedFile::openBuffer(const unsigned char* bytes, uint64_t length){
+	close();
+	filedata = bytes;
+	filelength = length;
+	runstats.filesopened++;
+	isinmemory = true;
+	isopen = true;
+	return true;
+}
+
+inline void MappedFile::close(){
+	if (isinmemory){
+		filedata = nullptr;
+	}
+	isinmemory = false;
+	#ifdef _WIN32
+	if (filedata != nullptr){
+		UnmapViewOfFile(filedata);
+	}
+	if (maphandle != NULL){
+		CloseHandle(maphandle);
+		maphandle = NULL;
+	}
+	if (filehandle != INVALID_HANDLE_VALUE){
+		CloseHandle(filehandle);
+		filehandle = INVALID_HANDLE_VALUE;
+	}
+	#else
+	if (filedata != nullptr){
+		munmap(const_cast<unsigned char*>(filedata), filelength);
+	}
+	if (filedescriptor >= 0){
+		::close(filedescriptor);
+		filedescriptor = -1;
+	}
+	#endif
+	filedata = nullptr;
+	filelength = 0;
+	isopen = false;
+	hasoverrun = false;
+}
+
+inline uint32_t MappedFile::intPluck(uint64_t offset) const {
+	if (inBounds(offset, 0x4) == false){
+		hasoverrun = true;
+		return 0;
+	}
+	//GMA and TPL values are always big endian
+	const unsigned char* ubuf = filedata + offset;
+	return (uint32_t(ubuf[0]) << 24) | (uint32_t(ubuf[1]) << 16) | (uint32_t(ubuf[2]) << 8) | uint32_t(ubuf[3]);
+}
+
+inline uint16_t MappedFile::shortPluck(uint64_t offset) const {
+	if (inBounds(offset, 0x2) == false){
+		hasoverrun = true;
+		return 0;
+	}
+	const unsigned char* ubuf = filedata + offset;
+	return (uint16_t(ubuf[0]) << 8) | uint16_t(ubuf[1]);
+}
+
+/*
+GMA and TPL integers are big endian. The host's byte order is known when compiling, so big endian hosts never swap anything.
+*/
+#if defined(__BYTE_ORDER__) && __BYTE_ORDER__ == __ORDER_BIG_ENDIAN__
+inline constexpr bool ishostbigendian = true;
+#else
+inline constexpr bool ishostbigendian = false;
+#endif
+
+inline uint32_t swapInt(uint32_t value){
+	#ifdef _MSC_VER
+	return _byteswap_ulong(value);
+	#else
+	return __builtin_bswap32(value);
+	#endif
+}
+
+/*
+Copies a table of big endian integers, adding adds[n % 4] to the nth one on the way. The source and destination can be the same.
+Offset tables repeat every 4 integers, so one pattern covers a whole table: {data, name, data, name} for GMA model offsets, and {0, offset, 0, 0} for TPL texture entries.
+With SSE2, 4 integers are swapped, added to and swapped back at once.
+*/
+inline void addToBigInts(const unsigned char* source, unsigned char* destination, uint64_t intamount, const uint32_t (&adds)[4]){
+	uint64_t intnumber = 0;
+	#ifdef GMATOOL_SSE2
+	if constexpr (ishostbigendian == false){
+		__m128i addvector = _mm_loadu_si128(reinterpret_cast<const __m128i*>(adds));
+		for (; intnumber + 4 <= intamount; intnumber += 4){
+			__m128i values = _mm_loadu_si128(reinterpret_cast<const __m128i*>(source + 4*intnumber));
+			//swapping the bytes in each short and then the shorts in each int swaps the whole int, with nothing past SSE2
+			values = _mm_or_si128(_mm_slli_epi16(values, 8), _mm_srli_epi16(values, 8));
+			values = _mm_shufflehi_epi16(_mm_shufflelo_epi16(values, _MM_SHUFFLE(2, 3, 0, 1)), _MM_SHUFFLE(2, 3, 0, 1));
+			values = _mm_add_epi32(values, addvector);
+			values = _mm_or_si128(_mm_slli_epi16(values, 8), _mm_srli_epi16(values, 8));
+			values = _mm_shufflehi_epi16(_mm_shufflelo_epi16(values, _MM_SHUFFLE(2, 3, 0, 1)), _MM_SHUFFLE(2, 3, 0, 1));
+			_mm_storeu_si128(reinterpret_cast<__m128i*>(destination + 4*intnumber), values);
+		}
+	}
+	#endif
+	for (; intnumber < intamount; intnumber++){
+		uint32_t value;
+		memcpy(&value, source + 4*intnumber, 4);
+		if constexpr (ishostbigendian){
+			value += adds[intnumber % 4];
+		} else {
+			value = swapInt(swapInt(value) + adds[intnumber % 4]);
+		}
+		memcpy(destination + 4*intnumber, &value, 4);
+	}
+}
+
+/*
+Runs job(0) to job(jobamount-1) across threadamount worker threads.
+Jobs are handed out one at a time, so a few big models or stages don't hold everything else up.
+*/
+inline void runJobs(size_t jobamount, unsigned int threadamount, const std::function<void(size_t)>& job){
+	if (threadamount <= 1 || jobamount <= 1){
+		for (size_t jobnumber = 0; jobnumber < jobamount; jobnumber++){
+			job(jobnumber);
+		}
+		return;
+	}
+	std::atomic<size_t> nextjob(0);
+	std::vector<std::thread> workers;
+	for (unsigned int workernumber = 0; workernumber < threadamount && workernumber < jobamount; workernumber++){
+		workers.emplace_back([&](){
+			for (size_t jobnumber = nextjob++; jobnumber < jobamount; jobnumber = nextjob++){
+				job(jobnumber);
+			}
+		});
+	}
+	for (std::thread& worker : workers){
+		worker.join();
+	}
+}
+
+/*
+Builds an output file in memory and writes it out in large blocks, so headers cost a handful of writes rather than one per field.
+Integers are always written big endian, like everything else in GMAs and TPLs.
+With openBuffer, the whole file is built in the caller's vector instead, and whenclosed is called once it's finished.
+*/
+class OutputBuilder {
+	public:
+	OutputBuilder(){}
+	~OutputBuilder(){
+		close();
+	}
+	OutputBuilder(const OutputBuilder&) = delete;
+	OutputBuilder& operator=(const OutputBuilder&) = delete;
+	bool open(std::string filename);
+	bool openExisting(std::string filename);
+	bool openBuffer(std::vector<unsigned char>& target, std::function<bool()> whenclosed = nullptr);
+	bool seek(uint64_t offset);
+	bool close();
+	bool flush();
+	uint64_t size() const {
+		if (isinmemory){
+			return memorytarget->size();
+		}
+		return writtenlength + buffer.size();
+	}
+	void putInt(uint32_t value){
+		unsigned char bytes[4] = {uint8_t(value >> 24), uint8_t(value >> 16), uint8_t(value >> 8), uint8_t(value)};
+		putBytes(bytes, 4);
+	}
+	void putShort(uint16_t value){
+		unsigned char bytes[2] = {uint8_t(value >> 8), uint8_t(value)};
+		putBytes(bytes, 2);
+	}
+	void putBytes(const void* bytes, uint64_t length);
+	void putZeroes(uint64_t length);
+	void putFrom(const MappedFile& bif, uint64_t offset, uint64_t length);
+	private:
+	bool writeOut(const unsigned char* bytes, uint64_t length);
+	bool copyFromFile(const MappedFile& bif, uint64_t offset, uint64_t length);
+	//anything this long skips the buffer and is written straight from where it already is
+	static const size_t flushlength = 0x100000;
+	//anything this long is copied file to file by the kernel where possible
+	static const size_t kernelcopylength = 0x10000;
+	std::vector<unsigned char> buffer;
+	uint64_t writtenlength = 0;
+	bool haswriteerror = false;
+	int filedescriptor = -1;
+	bool isinmemory = false;
+	std::vector<unsigned char>* memorytarget = nullptr;
+	std::function<bool()> whenclosed;
+};
+
+inline bool OutputBuilder::open(std::string filename){
+	close();
+	haswriteerror = false;
+	writtenlength = 0;
+	buffer.reserve(flushlength);
+	#ifdef _WIN32
+	filedescriptor = _open(filename.c_str(), _O_WRONLY | _O_CREAT | _O_TRUNC | _O_BINARY, _S_IREAD | _S_IWRITE);
+	#else
+	filedescriptor = ::open(filename.c_str(), O_WRONLY | O_CREAT | O_TRUNC, 0644);
+	#endif
+	return filedescriptor >= 0;
+}
+
+inline bool OutputBuilder::openExisting(std::string filename){
+	//like open, but keeps what's already in the file so parts of it can be overwritten
+	close();
+	haswriteerror = false;
+	writtenlength = 0;
+	buffer.reserve(flushlength);
+	#ifdef _WIN32
+	filedescriptor = _open(filename.c_str(), _O_WRONLY | _O_BINARY);
+	#else
+	filedescriptor = ::open(filename.c_str(), O_WRONLY);
+	#endif
+	return filedescriptor >= 0;
+}
+
+inline bool OutputBuilder::openBuffer(std::vector<unsigned char>& target, std::function<bool()> whenclosed){
+	close();
+	haswriteerror = false;
+	writtenlength = 0;
+	target.clear();
+	memorytarget = &target;
+	this->whenclosed = whenclosed;
+	isinmemory = true;
+	return true;
+}
+
+inline bool OutputBuilder::seek(uint64_t offset){
+	if (offset == size()){
+		//already there, so there's nothing to flush
+		return haswriteerror == false;
+	}
+	//only files opened with openExisting are written out of order, and those are never in memory
+	if (isinmemory || filedescriptor < 0 || flush() == false){
+		return false;
+	}
+	#ifdef _WIN32
+	bool isseeked = _lseeki64(filedescriptor, offset, SEEK_SET) >= 0;
+	#else
+	bool isseeked = lseek(filedescriptor, offset, SEEK_SET) >= 0;
+	#endif
+	runstats.seeks++;
+	if (isseeked == false){
+		haswriteerror = true;
+		return false;
+	}
+	writtenlength = offset;
+	return true;
+}
+
+inline bool OutputBuilder::close(){
+	if (isinmemory){
+		isinmemory = false;
+		memorytarget = nullptr;
+		std::function<bool()> finished;
+		finished.swap(whenclosed);
+		return (finished != nullptr) ? finished() : true;
+	}
+	if (filedescriptor < 0){
+		return false;
+	}
+	flush();
+	#ifdef _WIN32
+	_close(filedescriptor);
+	#else
+	::close(filedescriptor);
+	#endif
+	filedescriptor = -1;
+	return haswriteerror == false;
+}
+
+inline bool OutputBuilder::flush(){
+	if (isinmemory){
+		return true;
+	}
+	if (buffer.empty() == false){
+		writeOut(buffer.data(), buffer.size());
+		buffer.clear();
+	}
+	return haswriteerror == false;
+}
+
+inline bool OutputBuilder::writeOut(const unsigned char* bytes, uint64_t length){
+	while (length > 0 && haswriteerror == false){
+		//writes can come back short, so keep going until it's all out
+		#ifdef _WIN32
+		int writelength = _write(filedescriptor, bytes, unsigned(std::min<uint64_t>(length, 0x40000000)));
+		#else
+		ssize_t writelength = ::write(filedescriptor, bytes, std::min<uint64_t>(length, 0x40000000));
+		if (writelength < 0 && errno == EINTR){
+			continue;
+		}
+		#endif
+		if (writelength <= 0){
+			haswriteerror = true;
+			return false;
+		}
+		runstats.writes++;
+		runstats.byteswritten += writelength;
+		bytes += writelength;
+		length -= writelength;
+		writtenlength += writelength;
+	}
+	return haswriteerror == false;
+}
+
+inline void OutputBuilder::putBytes(const void* bytes, uint64_t length){
+	const unsigned char* ubytes = reinterpret_cast<const unsigned char*>(bytes);
+	if (isinmemory){
+		memorytarget->insert(memorytarget->end(), ubytes, ubytes + length);
+		return;
+	}
+	if (buffer.size() + length > flushlength){
+		flush();
+		if (length >= flushlength){
+			writeOut(ubytes, length);
+			return;
+		}
+	}
+	buffer.insert(buffer.end(), ubytes, ubytes + length);
+}
+
+inline void OutputBuilder::putZeroes(uint64_t length){
+	if (isinmemory){
+		memorytarget->resize(memorytarget->size() + length, 0x0);
+		return;
+	}
+	while (length > 0){
+		if (buffer.size() == flushlength){
+			flush();
+		}
+		uint64_t zerolength = std::min<uint64_t>(length, flushlength - buffer.size());
+		buffer.resize(buffer.size() + zerolength, 0x0);
+		length -= zerolength;
+	}
+}
+
+inline void OutputBuilder::putFrom(const MappedFile& bif, uint64_t offset, uint64_t length){
+	if (bif.inBounds(offset, length) == false){
+		//only copy what actually exists
+		bif.markOverrun();
+		length = (offset < bif.length()) ? bif.length() - offset : 0;
+	}
+	if (length >= kernelcopylength && copyFromFile(bif, offset, length)){
+		return;
+	}
+	if (length > 0){
+		putBytes(bif.data() + offset, length);
+	}
+}
+
+inline bool OutputBuilder::copyFromFile(const MappedFile& bif, uint64_t offset, uint64_t length){
+	/*
+	Big unmodified ranges like model bodies and texture data go straight from file to file without passing through here.
+	copy_file_range can share or clone the data on filesystems that support it, and sendfile covers everything else on Linux.
+	If neither can be used, whatever's left is written straight out of the mapped input.
+	*/
+	#ifdef __linux__
+	if (bif.descriptor() < 0 || filedescriptor < 0 || flush() == false){
+		return false;
+	}
+	loff_t inputoffset = offset;
+	bool usecopyfilerange = true;
+	while (length > 0 && usecopyfilerange){
+		ssize_t copiedlength = copy_file_range(bif.descriptor(), &inputoffset, filedescriptor, NULL, length, 0);
+		if (copiedlength < 0 && errno == EINTR){
+			continue;
+		}
+		if (copiedlength <= 0){
+			//not supported between these two files (or by this kernel)
+			usecopyfilerange = false;
+			break;
+		}
+		runstats.kernelcopies++;
+		runstats.bytescopied += copiedlength;
+		length -= copiedlength;
+		writtenlength += copiedlength;
+	}
+	while (length > 0){
+		off_t sendoffset = inputoffset;
+		ssize_t sentlength = sendfile(filedescriptor, bif.descriptor(), &sendoffset, std::min<uint64_t>(length, 0x40000000));
+		if (sentlength < 0 && errno == EINTR){
+			continue;
+		}
+		if (sentlength <= 0){
+			break;
+		}
+		runstats.kernelcopies++;
+		runstats.bytescopied += sentlength;
+		inputoffset += sentlength;
+		length -= sentlength;
+		writtenlength += sentlength;
+	}
+	if (length > 0){
+		writeOut(bif.data() + inputoffset, length);
+	}
+	return true;
+	#else
+	return false;
+	#endif
+}
+
+/*
+Everything that reads or writes stages is handed a host, which is how it reaches the outside world.
+Inputs and outputs are opened through it, so a host can hand over files it already has in memory or collect the outputs somewhere other than the disk.
+Messages for the user go to it a line at a time, rather than being printed, and can come from several threads at once.
+Failures are still returned as well, so a host that only wants to know whether something worked can ignore the messages.
+*/
+class Host {
+	public:
+	virtual ~Host(){}
+	virtual bool openInput(MappedFile& file, std::string filename){
+		return file.open(filename);
+	}
+	virtual bool openOutput(OutputBuilder& file, std::string filename){
+		return file.open(filename);
+	}
+	virtual void message(std::string line) = 0;
+};
+
+/*
+The TPL header is 0x04 bytes, then 0x10 for each texture, padded to a multiple of 0x20.
+*/
+inline uint64_t tplHeaderLength(uint64_t textureamount){
+	if (textureamount == 0){
+		return 0x04;
+	}
+	uint64_t tplpureheaderlength = 0x04 + 0x10*textureamount;
+	return tplpureheaderlength + ((-tplpureheaderlength) % 0x20);
+}
+
+/*
+Every offset in a GMA or TPL is 32 bits, and materials only have 16 bits for a texture number, so that's as big as any output can get.
+Lengths are worked out in 64 bits and checked with this before anything is written, so anything too big is refused instead of being saved with offsets that have wrapped around.
+Returns what's too big, or nothing if it all fits.
+*/
+const uint64_t maxoffset = 0xFFFFFFFF;
+const uint64_t maxtextureamount = 0x10000;
+
+inline std::string checkOutputLimits(uint64_t gmaheaderlength, uint64_t gmadatalength, uint64_t textureamount, uint64_t tpllength){
+	if (gmaheaderlength > maxoffset){
+		return "its GMA header would be " + std::to_string(gmaheaderlength) + " bytes long";
+	}
+	if (gmadatalength > maxoffset){
+		return "its GMA would have " + std::to_string(gmadatalength) + " bytes of model data";
+	}
+	if (textureamount > maxtextureamount){
+		return "it would have " + std::to_string(textureamount) + " textures, and materials can only use " + std::to_string(maxtextureamount);
+	}
+	if (tpllength > maxoffset){
+		return "its TPL would be " + std::to_string(tpllength) + " bytes long";
+	}
+	return "";
+}
+
+/*
+Read-only views of a GMA or TPL in memory, which -v checks stages through and indexes are built through.
+Nothing is copied or allocated: every value is read straight from the bytes when it's asked for, so the bytes have to stay where they are while a view is in use.
+Offsets come back as the headers give them (made absolute), so they can be checked, and anything read from past the end of the bytes is 0.
+The models, materials and textures handed out by operator[] and range-based for loops are cut down to what's inside the bytes, so they're always safe to read.
+*/
+inline uint32_t readBigInt(const unsigned char* bytes, uint64_t length, uint64_t offset){
+	if (offset > length || length - offset < 0x4){
+		return 0;
+	}
+	bytes += offset;
+	return (uint32_t(bytes[0]) << 24) | (uint32_t(bytes[1]) << 16) | (uint32_t(bytes[2]) << 8) | uint32_t(bytes[3]);
+}
+
+inline uint16_t readBigShort(const unsigned char* bytes, uint64_t length, uint64_t offset){
+	if (offset > length || length - offset < 0x2){
+		return 0;
+	}
+	bytes += offset;
+	return (uint16_t(bytes[0]) << 8) | uint16_t(bytes[1]);
+}
+
+//loops over anything with an operator[] and an amount of items
+template <class View>
+class ViewIterator {
+	public:
+	ViewIterator(const View* view, uint32_t itemnumber) : view(view), itemnumber(itemnumber) {}
+	auto operator*() const {
+		return (*view)[itemnumber];
+	}
+	ViewIterator& operator++(){
+		itemnumber++;
+		return *this;
+	}
+	bool operator!=(const ViewIterator& other) const {
+		return itemnumber != other.itemnumber;
+	}
+	private:
+	const View* view;
+	uint32_t itemnumber;
+};
+
+class GmaMaterial {
+	public:
+	GmaMaterial(const unsigned char* bytes) : bytes(bytes) {}
+	//all 0x20 bytes of the material
+	const unsigned char* data() const {
+		return bytes;
+	}
+	uint16_t textureNumber() const {
+		return readBigShort(bytes, 0x20, 0x04);
+	}
+	private:
+	const unsigned char* bytes;
+};
+
+class GmaModel {
+	public:
+	GmaModel(std::string_view modelname, const unsigned char* bytes, uint64_t length) : modelname(modelname), bytes(bytes), modellength(length) {}
+	std::string_view name() const {
+		return modelname;
+	}
+	//everything from the 0x40 byte model header to the start of the next model
+	const unsigned char* data() const {
+		return bytes;
+	}
+	uint64_t length() const {
+		return modellength;
+	}
+	//the number of materials the model header gives, whether or not they fit
+	uint16_t materialAmount() const {
+		return readBigShort(bytes, modellength, 0x18);
+	}
+	bool materialsFit() const {
+		return modellength >= 0x40 && 0x40 + 0x20*uint64_t(materialAmount()) <= modellength;
+	}
+	GmaMaterial operator[](uint16_t materialnumber) const {
+		return GmaMaterial(bytes + 0x40 + 0x20*materialnumber);
+	}
+	ViewIterator<GmaModel> begin() const {
+		return ViewIterator<GmaModel>(this, 0);
+	}
+	//only the materials that fit in the model are looped over
+	ViewIterator<GmaModel> end() const {
+		uint32_t fittingamount = (modellength < 0x40) ? 0 : std::min<uint64_t>(materialAmount(), (modellength - 0x40) / 0x20);
+		return ViewIterator<GmaModel>(this, fittingamount);
+	}
+	private:
+	std::string_view modelname;
+	const unsigned char* bytes;
+	uint64_t modellength;
+};
+
+class GmaFile {
+	public:
+	GmaFile(const unsigned char* bytes, uint64_t length) : bytes(bytes), filelength(length) {}
+	GmaFile(const MappedFile& file) : bytes(file.data()), filelength(file.length()) {}
+	uint64_t length() const {
+		return filelength;
+	}
+	uint32_t modelAmount() const {
+		return readBigInt(bytes, filelength, 0x0);
+	}
+	uint64_t headerLength() const {
+		return readBigInt(bytes, filelength, 0x4);
+	}
+	uint64_t nameListStart() const {
+		return 0x08 + 0x08*uint64_t(modelAmount());
+	}
+	//whether the model offsets fit, and the header length is after them and inside the file
+	bool check() const {
+		return filelength >= 0x8 && nameListStart() <= filelength && headerLength() >= nameListStart() && headerLength() <= filelength;
+	}
+	uint64_t nameOffset(uint32_t modelnumber) const {
+		return nameListStart() + readBigInt(bytes, filelength, 0x0C + 0x08*uint64_t(modelnumber));
+	}
+	//relative to the end of the header
+	uint32_t dataOffset(uint32_t modelnumber) const {
+		return readBigInt(bytes, filelength, 0x08 + 0x08*uint64_t(modelnumber));
+	}
+	uint64_t modelStart(uint32_t modelnumber) const {
+		return headerLength() + dataOffset(modelnumber);
+	}
+	//each model ends where the next one begins, and the last one ends at the end of the file
+	uint64_t modelEnd(uint32_t modelnumber) const {
+		return (modelnumber+1 >= modelAmount()) ? filelength : modelStart(modelnumber+1);
+	}
+	GmaModel operator[](uint32_t modelnumber) const {
+		uint64_t headerlength = std::min(headerLength(), filelength);
+		uint64_t nameoffset = nameOffset(modelnumber);
+		std::string_view modelname;
+		if (nameoffset < headerlength){
+			const void* nameend = memchr(bytes + nameoffset, 0, headerlength - nameoffset);
+			uint64_t namelength = (nameend != nullptr) ? reinterpret_cast<const unsigned char*>(nameend) - (bytes + nameoffset) : headerlength - nameoffset;
+			modelname = std::string_view(reinterpret_cast<const char*>(bytes + nameoffset), namelength);
+		}
+		uint64_t modelstart = std::min(filelength, modelStart(modelnumber));
+		uint64_t modelend = std::min(filelength, modelEnd(modelnumber));
+		return GmaModel(modelname, bytes + modelstart, std::max(modelstart, modelend) - modelstart);
+	}
+	ViewIterator<GmaFile> begin() const {
+		return ViewIterator<GmaFile>(this, 0);
+	}
+	ViewIterator<GmaFile> end() const {
+		return ViewIterator<GmaFile>(this, check() ? modelAmount() : 0);
+	}
+	private:
+	const unsigned char* bytes;
+	uint64_t filelength;
+};
+
+class TplTexture {
+	public:
+	TplTexture(const unsigned char* header, uint64_t headerlength, const unsigned char* bytes, uint64_t length) : header(header), headerlength(headerlength), bytes(bytes), texturelength(length) {}
+	uint32_t format() const {
+		return readBigInt(header, headerlength, 0x0);
+	}
+	uint16_t width() const {
+		return readBigShort(header, headerlength, 0x8);
+	}
+	uint16_t height() const {
+		return readBigShort(header, headerlength, 0xA);
+	}
+	uint16_t mipmapAmount() const {
+		return readBigShort(header, headerlength, 0xC);
+	}
+	const unsigned char* data() const {
+		return bytes;
+	}
+	uint64_t length() const {
+		return texturelength;
+	}
+	private:
+	const unsigned char* header;
+	uint64_t headerlength;
+	const unsigned char* bytes;
+	uint64_t texturelength;
+};
+
+class TplFile {
+	public:
+	TplFile(const unsigned char* bytes, uint64_t length) : bytes(bytes), filelength(length) {}
+	TplFile(const MappedFile& file) : bytes(file.data()), filelength(file.length()) {}
+	uint64_t length() const {
+		return filelength;
+	}
+	uint32_t textureAmount() const {
+		return readBigInt(bytes, filelength, 0x0);
+	}
+	uint64_t entriesEnd() const {
+		return 0x04 + 0x10*uint64_t(textureAmount());
+	}
+	//whether the texture entries fit
+	bool check() const {
+		return filelength >= 0x4 && entriesEnd() <= filelength;
+	}
+	uint64_t textureStart(uint32_t texturenumber) const {
+		return readBigInt(bytes, filelength, 0x08 + 0x10*uint64_t(texturenumber));
+	}
+	//each texture's data runs until the next texture's data begins
+	uint64_t textureEnd(uint32_t texturenumber) const {
+		return (texturenumber+1 >= textureAmount()) ? filelength : textureStart(texturenumber+1);
+	}
+	TplTexture operator[](uint32_t texturenumber) const {
+		uint64_t textureheaderpos = std::min(0x04 + 0x10*uint64_t(texturenumber), filelength);
+		uint64_t texturestart = std::min(filelength, textureStart(texturenumber));
+		uint64_t textureend = std::min(filelength, textureEnd(texturenumber));
+		return TplTexture(bytes + textureheaderpos, std::min<uint64_t>(0x10, filelength - textureheaderpos), bytes + texturestart, std::max(texturestart, textureend) - texturestart);
+	}
+	ViewIterator<TplFile> begin() const {
+		return ViewIterator<TplFile>(this, 0);
+	}
+	ViewIterator<TplFile> end() const {
+		return ViewIterator<TplFile>(this, check() ? textureAmount() : 0);
+	}
+	private:
+	const unsigned char* bytes;
+	uint64_t filelength;
+};
+
+/*
+Where indexes keep their tables.
+Given a block of memory, an arena hands out pieces of it and never allocates anything itself: once the block is used up, take gives nullptr.
+Otherwise it allocates blocks of its own as they're needed.
+Nothing it hands out ever moves, and clear makes all of it available again without giving anything back, so an arena can be reused stage after stage.
+Only things without destructors go in an arena, as nothing it hands out is ever destroyed.
+*/
+class IndexArena {
+	public:
+	IndexArena(){}
+	IndexArena(void* block, uint64_t length) : block(static_cast<unsigned char*>(block)), blocklength(length), isfixed(true) {}
+	IndexArena(const IndexArena&) = delete;
+	IndexArena& operator=(const IndexArena&) = delete;
+	template <class Item>
+	Item* take(uint64_t amount);
+	void clear(){
+		usedlength = 0;
+		if (isfixed == false){
+			//start again from the first block it allocated
+			block = nullptr;
+			blocklength = 0;
+			nextblocknumber = 0;
+		}
+	}
+	private:
+	static constexpr uint64_t ownblocklength = 0x10000;
+	unsigned char* block = nullptr;
+	uint64_t blocklength = 0;
+	uint64_t usedlength = 0;
+	bool isfixed = false;
+	std::vector<std::pair<std::unique_ptr<unsigned char[]>, uint64_t>> ownblocks;
+	size_t nextblocknumber = 0;
+};
+
+template <class Item>
+inline Item* IndexArena::take(uint64_t amount){
+	static_assert(std::is_trivially_destructible<Item>::value, "nothing in an arena is ever destroyed");
+	if (amount > (UINT64_MAX - alignof(Item)) / sizeof(Item)){
+		return nullptr;
+	}
+	uint64_t length = sizeof(Item)*amount;
+	while (true){
+		uintptr_t blockstart = reinterpret_cast<uintptr_t>(block);
+		uint64_t itemstart = ((blockstart + usedlength + alignof(Item) - 1) & ~uintptr_t(alignof(Item) - 1)) - blockstart;
+		if (block != nullptr && itemstart <= blocklength && blocklength - itemstart >= length){
+			usedlength = itemstart + length;
+			Item* items = reinterpret_cast<Item*>(block + itemstart);
+			std::uninitialized_value_construct_n(items, amount);
+			return items;
+		}
+		if (isfixed){
+			return nullptr;
+		}
+		//whatever's left of this block is too small, so carry on in the next one
+		if (nextblocknumber == ownblocks.size()){
+			uint64_t newblocklength = std::max<uint64_t>(ownblocklength, length + alignof(Item));
+			ownblocks.push_back({std::unique_ptr<unsigned char[]>(new unsigned char[newblocklength]), newblocklength});
+		}
+		block = ownblocks[nextblocknumber].first.get();
+		blocklength = ownblocks[nextblocknumber].second;
+		usedlength = 0;
+		nextblocknumber++;
+	}
+}
+
+/*
+The GMA header, parsed in one pass through a GmaFile view.
+Model names point straight into the mapped GMA, and the tables are in an arena, so an index is only valid while its GMA is still open and its arena hasn't been cleared.
+*/
+struct GmaIndex {
+	uint32_t modelamount = 0;
+	uint64_t headerlength = 0;
+	uint64_t filelength = 0;
+	uint64_t nameliststart = 0;
+	uint64_t namelistend = 0; //one past the 00 byte of the furthest name
+	uint32_t* dataoffsets = nullptr;
+	std::string_view* modelnames = nullptr;
+	uint64_t modelStart(uint32_t modelnumber) const {
+		return headerlength + dataoffsets[modelnumber];
+	}
+	uint64_t modelEnd(uint32_t modelnumber) const {
+		//each model ends where the next one begins, and the last one ends at the end of the file
+		if (modelnumber+1 == modelamount){
+			return filelength;
+		}
+		return headerlength + dataoffsets[modelnumber+1];
+	}
+	uint64_t namelistLength() const {
+		return namelistend - nameliststart;
+	}
+	int findModel(std::string_view modelname) const {
+		//only -me looks a model up by name, and only the one, so there's no table of names to keep
+		for (uint32_t modelnumber = 0; modelnumber < modelamount; modelnumber++){
+			if (modelnames[modelnumber] == modelname){
+				return modelnumber;
+			}
+		}
+		return -1;
+	}
+};
+
+/*
+Returns false if the GMA is truncated or corrupt, in which case it's marked as overrun, or if the arena has run out, in which case it isn't.
+*/
+inline bool buildGmaIndex(const MappedFile& gma, IndexArena& arena, GmaIndex& index){
+	PhaseTimer timer(indexphase);
+	GmaFile view(gma);
+	index = GmaIndex();
+	index.modelamount = view.modelAmount();
+	index.headerlength = view.headerLength();
+	index.filelength = view.length();
+	index.nameliststart = view.nameListStart();
+	index.namelistend = index.nameliststart;
+	//the offset table has to fit in the file before anything can be read from it
+	if (gma.inBounds(0x08, index.nameliststart - 0x08) == false){
+		gma.markOverrun();
+		return false;
+	}
+	index.dataoffsets = arena.take<uint32_t>(index.modelamount);
+	index.modelnames = arena.take<std::string_view>(index.modelamount);
+	if (index.dataoffsets == nullptr || index.modelnames == nullptr){
+		return false;
+	}
+	for (uint32_t modelnumber = 0; modelnumber < index.modelamount; modelnumber++){
+		index.dataoffsets[modelnumber] = view.dataOffset(modelnumber);
+		uint64_t modelnameoffset = view.nameOffset(modelnumber);
+		if (modelnameoffset >= index.filelength){
+			gma.markOverrun();
+			return false;
+		}
+		//names at the very end of a truncated file won't have their 00 byte
+		const char* modelnamestart = reinterpret_cast<const char*>(gma.data() + modelnameoffset);
+		const void* nameend = memchr(modelnamestart, 0, index.filelength - modelnameoffset);
+		uint64_t modelnamecharacters = (nameend != nullptr) ? reinterpret_cast<const char*>(nameend) - modelnamestart : index.filelength - modelnameoffset;
+		index.modelnames[modelnumber] = std::string_view(modelnamestart, modelnamecharacters);
+		index.namelistend = std::max(index.namelistend, std::min(modelnameoffset + modelnamecharacters + 1, index.filelength));
+	}
+	return true;
+}
+
+/*
+The TPL header, parsed in one pass through a TplFile view.
+Each texture's header is 0x10 bytes long, starting at 0x04, and its data runs until the next texture's data begins.
+*/
+struct TplIndex {
+	uint32_t textureamount = 0;
+	uint64_t filelength = 0;
+	uint32_t* textureoffsets = nullptr;
+	uint64_t headerPosition(uint32_t texturenumber) const {
+		return 0x04 + 0x10*uint64_t(texturenumber);
+	}
+	uint64_t headerLength() const {
+		//the first texture always starts straight after the header
+		if (textureamount == 0){
+			return 0x04;
+		}
+		return textureoffsets[0];
+	}
+	uint64_t textureStart(uint32_t texturenumber) const {
+		if (texturenumber >= textureamount){
+			return 0;
+		}
+		return textureoffsets[texturenumber];
+	}
+	uint64_t textureEnd(uint32_t texturenumber) const {
+		if (texturenumber >= textureamount){
+			return 0;
+		}
+		if (texturenumber+1 == textureamount){
+			return filelength;
+		}
+		return textureoffsets[texturenumber+1];
+	}
+};
+
+inline bool buildTplIndex(const MappedFile& tpl, IndexArena& arena, TplIndex& index){
+	PhaseTimer timer(indexphase);
+	TplFile view(tpl);
+	index = TplIndex();
+	index.textureamount = view.textureAmount();
+	index.filelength = view.length();
+	if (tpl.inBounds(0x04, view.entriesEnd() - 0x04) == false){
+		tpl.markOverrun();
+		return false;
+	}
+	index.textureoffsets = arena.take<uint32_t>(index.textureamount);
+	if (index.textureoffsets == nullptr){
+		return false;
+	}
+	for (uint32_t texturenumber = 0; texturenumber < index.textureamount; texturenumber++){
+		index.textureoffsets[texturenumber] = view.textureStart(texturenumber);
+	}
+	return true;
+}
+
+/*
+64-bit FNV-1a, used to spot identical data without comparing everything to everything.
+*/
+inline uint64_t hashBytes(const unsigned char* bytes, uint64_t length, uint64_t hash = 0xcbf29ce484222325){
+	for (uint64_t bytenumber = 0; bytenumber < length; bytenumber++){
+		hash = (hash ^ bytes[bytenumber]) * 0x100000001b3;
+	}
+	return hash;
+}
+
+/*
+Two textures are the same if everything in their headers but the offset matches, along with all of their data.
+*/
+inline uint64_t hashTexture(const MappedFile& tpl, const TplIndex& tplindex, uint32_t texturenumber){
+	uint64_t textureheaderpos = tplindex.headerPosition(texturenumber);
+	uint64_t texturestart = tplindex.textureStart(texturenumber);
+	uint64_t textureend = tplindex.textureEnd(texturenumber);
+	if (tpl.inBounds(textureheaderpos, 0x10) == false || textureend < texturestart || tpl.inBounds(texturestart, textureend - texturestart) == false){
+		tpl.markOverrun();
+		return 0;
+	}
+	uint64_t hash = hashBytes(tpl.data() + textureheaderpos, 0x04);
+	hash = hashBytes(tpl.data() + textureheaderpos + 0x08, 0x08, hash);
+	return hashBytes(tpl.data() + texturestart, textureend - texturestart, hash);
+}
+
+inline bool isSameTexture(const MappedFile& tpl1, const TplIndex& tpl1index, uint32_t texture1number, const MappedFile& tpl2, const TplIndex& tpl2index, uint32_t texture2number){
+	uint64_t texture1start = tpl1index.textureStart(texture1number);
+	uint64_t texture1length = tpl1index.textureEnd(texture1number) - texture1start;
+	uint64_t texture2start = tpl2index.textureStart(texture2number);
+	uint64_t texture2length = tpl2index.textureEnd(texture2number) - texture2start;
+	uint64_t header1pos = tpl1index.headerPosition(texture1number);
+	uint64_t header2pos = tpl2index.headerPosition(texture2number);
+	if (texture1length != texture2length || tpl1.inBounds(texture1start, texture1length) == false || tpl2.inBounds(texture2start, texture2length) == false){
+		return false;
+	}
+	return tpl1.intPluck(header1pos) == tpl2.intPluck(header2pos)
+		&& tpl1.intPluck(header1pos+0x08) == tpl2.intPluck(header2pos+0x08)
+		&& tpl1.intPluck(header1pos+0x0C) == tpl2.intPluck(header2pos+0x0C)
+		&& memcmp(tpl1.data() + texture1start, tpl2.data() + texture2start, texture1length) == 0;
+}
+
+/*
+Matches a model name against a pattern, where * matches any run of characters and ? matches any one character.
+*/
+inline bool globMatch(std::string_view pattern, std::string_view modelname){
+	size_t patternpointer = 0;
+	size_t namepointer = 0;
+	//where to resume from if the characters after the last * stop matching
+	size_t starpointer = std::string_view::npos;
+	size_t starnamepointer = 0;
+	while (namepointer < modelname.length()){
+		if (patternpointer < pattern.length() && (pattern[patternpointer] == '?' || pattern[patternpointer] == modelname[namepointer])){
+			patternpointer++;
+			namepointer++;
+		} else if (patternpointer < pattern.length() && pattern[patternpointer] == '*'){
+			starpointer = patternpointer++;
+			starnamepointer = namepointer;
+		} else if (starpointer != std::string_view::npos){
+			patternpointer = starpointer + 1;
+			namepointer = ++starnamepointer;
+		} else {
+			return false;
+		}
+	}
+	while (patternpointer < pattern.length() && pattern[patternpointer] == '*'){
+		patternpointer++;
+	}
+	return patternpointer == pattern.length();
+}
+
+inline bool isGlobPattern(std::string_view pattern){
+	return pattern.find_first_of("*?") != std::string_view::npos;
+}
+
+/*
+
+Part 1:
+Goal Extraction
+
+*/
+
+/*
+Maps texture numbers in a source TPL to texture numbers in a new one, numbered in the order they're first used.
+*/
+struct TextureRemap {
+	std::unordered_map<uint32_t, uint16_t> newtexturenumbers;
+	std::vector<uint32_t> oldtexturenumbers;
+	uint16_t remap(uint32_t oldtexturenumber){
+		auto found = newtexturenumbers.try_emplace(oldtexturenumber, uint16_t(oldtexturenumbers.size()));
+		if (found.second){
+			//first time this texture's been used
+			oldtexturenumbers.push_back(oldtexturenumber);
+		}
+		return found.first->second;
+	}
+};
+
+/*
+A set of models to be written out together to <outputname>.gma and .tpl.
+Textures are numbered in the order the pack's models first use them, so a one-model pack matches what's always been extracted.
+*/
+struct ModelPack {
+	std::string outputname;
+	std::vector<uint32_t> modelnumbers;
+	TextureRemap textureremap;
+};
+
+inline bool writeModelPacks(Host& host, const MappedFile& oldgma, const MappedFile& oldtpl, const GmaIndex& gmaindex, const TplIndex& tplindex, std::vector<ModelPack>& packs){
+	/*
+	These files will create standalone TPL and GMA files, designed to be easily integrated into the main file.
+	Every pack's models are numbered and its lengths worked out before anything is opened, so a pack that's too big never leaves half-written files behind.
+	Then each pack is written straight through, one file after the other: the GMA header and models, then the TPL header and textures in the order the models first use them.
+	*/
+	PhaseTimer timer(headerphase);
+	size_t packamount = packs.size();
+	for (ModelPack& pack : packs){
+		//models are written in the order they're in the source
+		std::sort(pack.modelnumbers.begin(), pack.modelnumbers.end());
+		uint64_t namelistlength = 0;
+		uint64_t gmadatalength = 0;
+		for (uint32_t modelnumber : pack.modelnumbers){
+			namelistlength += gmaindex.modelnames[modelnumber].length() + 1;
+			gmadatalength += gmaindex.modelEnd(modelnumber) - gmaindex.modelStart(modelnumber);
+			//number the textures while we're here
+			uint64_t oldstartpoint = gmaindex.modelStart(modelnumber);
+			uint16_t materialamount = oldgma.shortPluck(oldstartpoint+0x18);
+			for (uint32_t materialnumber = 0; materialnumber < materialamount; materialnumber++){
+				pack.textureremap.remap(oldgma.shortPluck(oldstartpoint+0x44+0x20*materialnumber));
+			}
+		}
+		uint64_t textureamount = pack.textureremap.oldtexturenumbers.size();
+		uint64_t tpllength = tplHeaderLength(textureamount);
+		for (uint32_t oldtexturenumber : pack.textureremap.oldtexturenumbers){
+			tpllength += tplindex.textureEnd(oldtexturenumber) - tplindex.textureStart(oldtexturenumber);
+		}
+		uint64_t gmapureheaderlength = 0x08 + 0x08*uint64_t(pack.modelnumbers.size()) + namelistlength;
+		std::string toobig = checkOutputLimits(gmapureheaderlength, gmadatalength, textureamount, tpllength);
+		if (toobig.empty() == false){
+			host.message(pack.outputname + " would be too big to save, as " + toobig + "!");
+			return false;
+		}
+	}
+	bool issaved = true;
+	for (size_t packnumber = 0; packnumber < packamount; packnumber++){
+		ModelPack& pack = packs[packnumber];
+		timer.switchTo(headerphase);
+		OutputBuilder newgma;
+		if (host.openOutput(newgma, pack.outputname + ".gma") == false){
+			return false;
+		}
+		uint32_t modelamount = pack.modelnumbers.size();
+		uint64_t namelistlength = 0;
+		for (uint32_t modelnumber : pack.modelnumbers){
+			namelistlength += gmaindex.modelnames[modelnumber].length() + 1;
+		}
+		/*
+		The GMA header is always a multiple of 0x20 in length, so it's padded after the model names.
+		*/
+		uint64_t gmapureheaderlength = 0x08 + 0x08*uint64_t(modelamount) + namelistlength;
+		uint32_t gmapadding = (-gmapureheaderlength) % 0x20;
+		newgma.putInt(modelamount);
+		newgma.putInt(gmapureheaderlength + gmapadding);
+		//Each model's data follows on from the one before, and so do the names
+		uint64_t dataoffset = 0;
+		uint64_t nameoffset = 0;
+		for (uint32_t modelnumber : pack.modelnumbers){
+			newgma.putInt(dataoffset);
+			newgma.putInt(nameoffset);
+			dataoffset += gmaindex.modelEnd(modelnumber) - gmaindex.modelStart(modelnumber);
+			nameoffset += gmaindex.modelnames[modelnumber].length() + 1;
+		}
+		for (uint32_t modelnumber : pack.modelnumbers){
+			newgma.putBytes(gmaindex.modelnames[modelnumber].data(), gmaindex.modelnames[modelnumber].length());
+			newgma.putZeroes(1);
+		}
+		newgma.putZeroes(gmapadding);
+		//Now the header is written, time for the main body
+		for (uint32_t modelnumber : pack.modelnumbers){
+			timer.switchTo(remapphase);
+			uint64_t oldstartpoint = gmaindex.modelStart(modelnumber);
+			uint64_t oldendpoint = gmaindex.modelEnd(modelnumber);
+			newgma.putFrom(oldgma, oldstartpoint, 0x40);
+			uint16_t materialamount = oldgma.shortPluck(oldstartpoint+0x18);
+			uint64_t oldmodelheaderlength = 0x40;
+			//Loop for each material
+			for (uint32_t materialnumber = 0; materialnumber < materialamount; materialnumber++){
+				newgma.putFrom(oldgma, oldstartpoint+0x40+0x20*materialnumber, 0x04);
+				uint16_t materialvalue = oldgma.shortPluck(oldstartpoint+0x44+0x20*materialnumber);
+				newgma.putShort(pack.textureremap.remap(materialvalue));
+				newgma.putFrom(oldgma, oldstartpoint+0x46+0x20*materialnumber, 0x1A);
+				oldmodelheaderlength += 0x20;
+			}
+			uint64_t oldmodeldatastart = oldstartpoint + oldmodelheaderlength;
+			uint64_t oldmodeldatalength = oldendpoint - oldmodeldatastart;
+			timer.switchTo(copyphase);
+			//rest of data
+			newgma.putFrom(oldgma, oldmodeldatastart, oldmodeldatalength);
+		}
+		issaved = newgma.close() && issaved;
+		//Then the TPL, with its textures in the order they were numbered
+		timer.switchTo(tplphase);
+		OutputBuilder newtpl;
+		if (host.openOutput(newtpl, pack.outputname + ".tpl") == false){
+			return false;
+		}
+		uint32_t textureamount = pack.textureremap.oldtexturenumbers.size();
+		uint64_t newtplheaderlength = tplHeaderLength(textureamount);
+		uint64_t rollingoffset = newtplheaderlength;
+		newtpl.putInt(textureamount);
+		for (uint32_t oldtexturenumber : pack.textureremap.oldtexturenumbers){
+			//copy initial bytes, then the offset, based on the length of the textures before it
+			uint64_t oldtextureheaderpos = tplindex.headerPosition(oldtexturenumber);
+			newtpl.putFrom(oldtpl, oldtextureheaderpos, 0x4);
+			newtpl.putInt(rollingoffset);
+			newtpl.putFrom(oldtpl, oldtextureheaderpos+0x08, 0x08);
+			rollingoffset += tplindex.textureEnd(oldtexturenumber) - tplindex.textureStart(oldtexturenumber);
+		}
+		//padding
+		newtpl.putZeroes(newtplheaderlength - newtpl.size());
+		for (uint32_t oldtexturenumber : pack.textureremap.oldtexturenumbers){
+			newtpl.putFrom(oldtpl, tplindex.textureStart(oldtexturenumber), tplindex.textureEnd(oldtexturenumber) - tplindex.textureStart(oldtexturenumber));
+		}
+		issaved = newtpl.close() && issaved;
+	}
+	return issaved;
+}
+
+inline bool modelWriteToFiles(Host& host, std::string filename, const MappedFile& oldgma, const MappedFile& oldtpl, const GmaIndex& gmaindex, const TplIndex& tplindex, uint32_t modelnumber, std::string suffix){
+	std::vector<ModelPack> packs(1);
+	packs[0].outputname = filename + "_" + suffix;
+	packs[0].modelnumbers.push_back(modelnumber);
+	return writeModelPacks(host, oldgma, oldtpl, gmaindex, tplindex, packs);
+}
+
+inline bool openModelSource(Host& host, std::string filename, MappedFile& gma, MappedFile& tpl, IndexArena& arena, GmaIndex& gmaindex, TplIndex& tplindex){
+	//open files and check that they're good
+	//
+	if (host.openInput(gma, filename + ".gma") == false) {
+		host.message("No GMA found! (" + filename + ".gma)");
+		return false;
+	}
+	if (host.openInput(tpl, filename + ".tpl") == false) {
+		host.message("No TPL found! (" + filename + ".tpl)");
+		return false;
+	}
+	//If the files are good we can read the gma for the files
+	if (buildGmaIndex(gma, arena, gmaindex) == false){
+		host.message(gma.overrun() ? "The model list in " + filename + ".gma is truncated or corrupt!" : "Ran out of index memory for " + filename + ".gma!");
+		return false;
+	}
+	if (buildTplIndex(tpl, arena, tplindex) == false){
+		host.message(tpl.overrun() ? "The texture list in " + filename + ".tpl is truncated or corrupt!" : "Ran out of index memory for " + filename + ".tpl!");
+		return false;
+	}
+	return true;
+}
+
+/*
+Reads past the end of a file come back as zeroes, so a truncated or corrupt file is only noticed after it's been used.
+Returns whether either file was read past the end, saying which one if so.
+*/
+inline bool reportOverrun(Host& host, std::string filename, const MappedFile& gma, const MappedFile& tpl){
+	if (gma.overrun() == false && tpl.overrun() == false){
+		return false;
+	}
+	host.message("Tried to read past the end of " + filename + (gma.overrun() ? ".gma" : ".tpl") + " - it may be truncated or corrupt!");
+	return true;
+}
+
+/*
+One model to be written out to <filename>_<suffix>.gma and .tpl.
+The label is what gets printed in front of "saved to" once it's done.
+*/
+struct ExtractJob {
+	uint32_t modelnumber;
+	std::string suffix;
+	std::string label;
+};
+
+/*
+A set of model name patterns, worked out once and then matched against every model in a single pass.
+A pattern is an exact model name, a pattern using * and ? as wildcards, or a regular expression after "re:".
+Anything after the last = is the suffix the model is saved with, and a fixed suffix only ever takes the first model that matches.
+Otherwise models are saved under their own names.
+A model goes to the first pattern it matches, so earlier patterns take priority, and it's never written more than once.
+*/
+class ModelSelector {
+	public:
+	bool add(std::string selection);
+	void addRule(std::string pattern, bool isregex, std::string suffix, std::string label);
+	void addGoals();
+	void addSwitches();
+	bool empty() const {
+		return rules.empty();
+	}
+	std::vector<ExtractJob> select(const GmaIndex& gmaindex, std::vector<bool>& isrulematched) const;
+	int findRule(std::string_view modelname) const;
+	std::string patternName(size_t rulenumber) const {
+		return rules[rulenumber].pattern;
+	}
+	private:
+	struct Rule {
+		std::string pattern;
+		bool isregex;
+		bool isexact;
+		std::regex expression;
+		std::string suffix; //empty means the model's own name
+		std::string label; //printed after the model name
+	};
+	bool ruleMatches(const Rule& rule, std::string_view modelname) const;
+	std::vector<Rule> rules;
+	std::unordered_map<std::string, size_t> exactrules; //exact names don't need to be compared against every model
+};
+
+inline bool ModelSelector::add(std::string selection){
+	if (selection == ":goals"){
+		addGoals();
+		return true;
+	}
+	if (selection == ":switches"){
+		addSwitches();
+		return true;
+	}
+	std::string suffix;
+	size_t equals = selection.rfind('=');
+	if (equals != std::string::npos && equals > 0){
+		suffix = selection.substr(equals+1);
+		selection = selection.substr(0, equals);
+	}
+	bool isregex = selection.compare(0, 3, "re:") == 0;
+	if (isregex){
+		try {
+			std::regex(selection.substr(3));
+		} catch (const std::regex_error&){
+			return false;
+		}
+	}
+	addRule(selection, isregex, suffix, "");
+	return true;
+}
+
+inline void ModelSelector::addRule(std::string pattern, bool isregex, std::string suffix, std::string label){
+	Rule rule;
+	rule.pattern = pattern;
+	rule.isregex = isregex;
+	rule.isexact = isregex == false && isGlobPattern(pattern) == false;
+	if (isregex){
+		rule.expression = std::regex(pattern.substr(3), std::regex::optimize);
+	}
+	rule.suffix = suffix;
+	rule.label = label;
+	if (rule.isexact){
+		exactrules.emplace(pattern, rules.size());
+	}
+	rules.push_back(rule);
+}
+
+inline void ModelSelector::addGoals(){
+	//goals are named like ST1_GOAL, with _G and _R after for the green and red ones
+	addRule("???_GOAL_G*", false, "GOAL_G", " (Green goal)");
+	addRule("???_GOAL_R*", false, "GOAL_R", " (Red goal)");
+	addRule("???_GOAL*", false, "GOAL_B", " (Blue goal)");
+}
+
+inline void ModelSelector::addSwitches(){
+	addRule("BUTTON_*", false, "", "");
+}
+
+inline bool ModelSelector::ruleMatches(const Rule& rule, std::string_view modelname) const {
+	if (rule.isregex){
+		return std::regex_match(modelname.begin(), modelname.end(), rule.expression);
+	}
+	if (rule.isexact){
+		return rule.pattern == modelname;
+	}
+	return globMatch(rule.pattern, modelname);
+}
+
+inline int ModelSelector::findRule(std::string_view modelname) const {
+	auto exactrule = exactrules.find(std::string(modelname));
+	size_t lastrulenumber = (exactrule != exactrules.end()) ? exactrule->second : rules.size();
+	for (size_t rulenumber = 0; rulenumber < lastrulenumber; rulenumber++){
+		if (rules[rulenumber].isexact == false && ruleMatches(rules[rulenumber], modelname)){
+			return rulenumber;
+		}
+	}
+	return (lastrulenumber < rules.size()) ? int(lastrulenumber) : -1;
+}
+
+inline std::vector<ExtractJob> ModelSelector::select(const GmaIndex& gmaindex, std::vector<bool>& isrulematched) const {
+	isrulematched.assign(rules.size(), false);
+	std::vector<ExtractJob> jobs;
+	for (uint32_t modelnumber = 0; modelnumber < gmaindex.modelamount; modelnumber++){
+		std::string_view modelname = gmaindex.modelnames[modelnumber];
+		int rulenumber = findRule(modelname);
+		if (rulenumber < 0){
+			continue;
+		}
+		const Rule& rule = rules[rulenumber];
+		if (rule.suffix.empty() == false && isrulematched[rulenumber]){
+			//a fixed suffix has already been used
+			continue;
+		}
+		isrulematched[rulenumber] = true;
+		std::string suffix = rule.suffix.empty() ? std::string(modelname) : rule.suffix;
+		jobs.push_back({modelnumber, suffix, std::string(modelname) + rule.label});
+	}
+	//later patterns matching a model that's already been taken still count as having matched
+	for (size_t rulenumber = 0; rulenumber < rules.size(); rulenumber++){
+		for (uint32_t modelnumber = 0; modelnumber < gmaindex.modelamount && isrulematched[rulenumber] == false; modelnumber++){
+			isrulematched[rulenumber] = ruleMatches(rules[rulenumber], gmaindex.modelnames[modelnumber]);
+		}
+	}
+	return jobs;
+}
+
+/*
+Two jobs with the same suffix would be saved to the same files, and with -j they'd both be writing them at once.
+The first one keeps the files, just like a fixed suffix only takes the first model it matches, and the rest are skipped.
+*/
+inline void dropCollidingJobs(Host& host, std::string filename, std::vector<ExtractJob>& jobs){
+	std::unordered_set<std::string> suffixes;
+	std::vector<ExtractJob> keptjobs;
+	for (ExtractJob& job : jobs){
+		if (suffixes.insert(job.suffix).second){
+			keptjobs.push_back(job);
+		} else {
+			host.message(job.label + " would be saved to " + filename + "_" + job.suffix + " as well, so it's been skipped!");
+		}
+	}
+	jobs.swap(keptjobs);
+}
+
+inline int writeExtractJobs(Host& host, std::string filename, const MappedFile& gma, const MappedFile& tpl, const GmaIndex& gmaindex, const TplIndex& tplindex, const std::vector<ExtractJob>& jobs, unsigned int threadamount, std::string combinedsuffix){
+	std::vector<ExtractJob> separatejobs = jobs;
+	if (combinedsuffix.empty() == false && jobs.empty() == false){
+		//every model goes into one pack, sharing one copy of each texture
+		std::vector<ModelPack> packs(1);
+		packs[0].outputname = filename + "_" + combinedsuffix;
+		std::string labels;
+		for (const ExtractJob& job : jobs){
+			packs[0].modelnumbers.push_back(job.modelnumber);
+			labels += (labels.empty() ? "" : ", ") + job.label;
+		}
+		if (jobs.size() > 10){
+			labels = std::to_string(jobs.size()) + " models";
+		}
+		if (writeModelPacks(host, gma, tpl, gmaindex, tplindex, packs) == false){
+			host.message("Couldn't save " + labels + " to " + packs[0].outputname + "!");
+			return -1;
+		}
+		host.message(labels + " saved to " + packs[0].outputname);
+		separatejobs.clear();
+	}
+	dropCollidingJobs(host, filename, separatejobs);
+	//every job reads from the same mapped files and writes to its own outputs, so they can all run at once
+	std::atomic<int> failedamount(0);
+	runJobs(separatejobs.size(), threadamount, [&](size_t jobnumber){
+		const ExtractJob& job = separatejobs[jobnumber];
+		if (modelWriteToFiles(host, filename, gma, tpl, gmaindex, tplindex, job.modelnumber, job.suffix)){
+			host.message(job.label + " saved to " + filename + "_" + job.suffix);
+		} else {
+			host.message("Couldn't save " + job.label + " to " + filename + "_" + job.suffix + "!");
+			failedamount++;
+		}
+	});
+	if (failedamount > 0 || reportOverrun(host, filename, gma, tpl)){
+		return -1;
+	}
+	return 0;
+}
+
+inline int modelExtract(Host& host, std::string filename, int type, std::string specificmodel, unsigned int threadamount, std::string combinedsuffix){
+	MappedFile gma;
+	MappedFile tpl;
+	IndexArena arena;
+	GmaIndex gmaindex;
+	TplIndex tplindex;
+	if (openModelSource(host, filename, gma, tpl, arena, gmaindex, tplindex) == false){
+		return -1;
+	}
+	std::vector<ExtractJob> jobs;
+	if (type == 1 || type == 2){
+		//Goal and switch extraction blocks
+		ModelSelector selector;
+		if (type == 1){
+			selector.addGoals();
+		} else {
+			selector.addSwitches();
+		}
+		std::vector<bool> isrulematched;
+		jobs = selector.select(gmaindex, isrulematched);
+		//a green or red goal also matches the blue goal's pattern, so only a saved blue goal counts
+		bool hasbluegoal = std::any_of(jobs.begin(), jobs.end(), [](const ExtractJob& job){
+			return job.suffix == "GOAL_B";
+		});
+		if (type == 1 && hasbluegoal == false){
+			host.message("No blue goal found! (" + filename + ")");
+		} else if (type == 2 && jobs.empty()){
+			host.message("No switches found! (" + filename + ")");
+		}
+	} else if (type == 3){
+		//Specific model extraction block
+		int modelnumber = gmaindex.findModel(specificmodel);
+		if (modelnumber >= 0){
+			jobs.push_back({uint32_t(modelnumber), specificmodel, specificmodel});
+		} else {
+			host.message("The model " + specificmodel + " wasn't found!");
+		}
+	}
+	return writeExtractJobs(host, filename, gma, tpl, gmaindex, tplindex, jobs, threadamount, combinedsuffix);
+}
+
+inline bool readManifest(std::string manifestname, std::vector<std::string>& selections){
+	std::ifstream manifest(manifestname);
+	if (manifest.good() == false){
+		return false;
+	}
+	std::string line;
+	while (std::getline(manifest, line)){
+		//skip windows line endings, blank lines and comments
+		if (line.empty() == false && line.back() == '\r'){
+			line.pop_back();
+		}
+		if (line.empty() || line[0] == '#'){
+			continue;
+		}
+		selections.push_back(line);
+	}
+	return true;
+}
+
+inline bool buildSelector(Host& host, const std::vector<std::string>& selections, ModelSelector& selector){
+	//Each selection is anything a ModelSelector takes, :goals or :switches for the same models as -ge and -se, or @ followed by a manifest file with one selection per line.
+	std::vector<std::string> expandedselections;
+	for (const std::string& selection : selections){
+		if (selection[0] == '@'){
+			if (readManifest(selection.substr(1), expandedselections) == false){
+				host.message("Manifest " + selection.substr(1) + " not found!");
+				return false;
+			}
+		} else {
+			expandedselections.push_back(selection);
+		}
+	}
+	for (std::string& selection : expandedselections){
+		if (selector.add(selection) == false){
+			host.message(selection + " isn't a valid regular expression!");
+			return false;
+		}
+	}
+	return true;
+}
+
+inline int batchExtract(Host& host, std::string filename, std::vector<std::string> selections, unsigned int threadamount, std::string combinedsuffix){
+	//The GMA and TPL are only opened and parsed once, however many models are extracted.
+	ModelSelector selector;
+	if (buildSelector(host, selections, selector) == false){
+		return -1;
+	}
+	MappedFile gma;
+	MappedFile tpl;
+	IndexArena arena;
+	GmaIndex gmaindex;
+	TplIndex tplindex;
+	if (openModelSource(host, filename, gma, tpl, arena, gmaindex, tplindex) == false){
+		return -1;
+	}
+	std::vector<bool> isrulematched;
+	std::vector<ExtractJob> jobs = selector.select(gmaindex, isrulematched);
+	for (size_t rulenumber = 0; rulenumber < isrulematched.size(); rulenumber++){
+		if (isrulematched[rulenumber] == false){
+			host.message("Nothing matched " + selector.patternName(rulenumber) + "!");
+		}
+	}
+	return writeExtractJobs(host, filename, gma, tpl, gmaindex, tplindex, jobs, threadamount, combinedsuffix);
+}
+
+inline int shardSplit(Host& host, std::string filename, std::vector<std::string> shardspecs){
+	/*
+	Splits a stage into several packs, <filename>_shard1 and so on, in one pass.
+	Either give the number of packs, and models are shared out so each pack has about the same amount of model and texture data,
+	or give a list of models for each pack, separated by commas, using anything -be takes. Models go to the first list they match.
+	*/
+	MappedFile gma;
+	MappedFile tpl;
+	IndexArena arena;
+	GmaIndex gmaindex;
+	TplIndex tplindex;
+	if (openModelSource(host, filename, gma, tpl, arena, gmaindex, tplindex) == false){
+		return -1;
+	}
+	std::vector<ModelPack> packs;
+	bool isbalanced = shardspecs.size() == 1 && std::all_of(shardspecs[0].begin(), shardspecs[0].end(), ::isdigit);
+	if (isbalanced){
+		uint32_t packamount = atoi(shardspecs[0].c_str());
+		if (packamount == 0){
+			host.message("There has to be at least one shard!");
+			return -1;
+		}
+		packs.resize(packamount);
+		//biggest models first, each into whichever pack is smallest so far
+		std::vector<std::pair<uint64_t, uint32_t>> modellengths;
+		for (uint32_t modelnumber = 0; modelnumber < gmaindex.modelamount; modelnumber++){
+			uint64_t modellength = gmaindex.modelEnd(modelnumber) - gmaindex.modelStart(modelnumber);
+			TextureRemap textureremap;
+			uint16_t materialamount = gma.shortPluck(gmaindex.modelStart(modelnumber)+0x18);
+			for (uint32_t materialnumber = 0; materialnumber < materialamount; materialnumber++){
+				textureremap.remap(gma.shortPluck(gmaindex.modelStart(modelnumber)+0x44+0x20*materialnumber));
+			}
+			for (uint32_t oldtexturenumber : textureremap.oldtexturenumbers){
+				modellength += tplindex.textureEnd(oldtexturenumber) - tplindex.textureStart(oldtexturenumber);
+			}
+			modellengths.push_back({modellength, modelnumber});
+		}
+		std::sort(modellengths.begin(), modellengths.end(), std::greater<std::pair<uint64_t, uint32_t>>());
+		std::vector<uint64_t> packlengths(packamount, 0);
+		for (std::pair<uint64_t, uint32_t>& modellength : modellengths){
+			size_t packnumber = std::min_element(packlengths.begin(), packlengths.end()) - packlengths.begin();
+			packs[packnumber].modelnumbers.push_back(modellength.second);
+			packlengths[packnumber] += modellength.first;
+		}
+	} else {
+		std::vector<ModelSelector> selectors(shardspecs.size());
+		for (size_t packnumber = 0; packnumber < shardspecs.size(); packnumber++){
+			std::vector<std::string> selections;
+			for (size_t selectionstart = 0; selectionstart <= shardspecs[packnumber].length();){
+				size_t comma = shardspecs[packnumber].find(',', selectionstart);
+				if (comma == std::string::npos){
+					comma = shardspecs[packnumber].length();
+				}
+				std::string selection = shardspecs[packnumber].substr(selectionstart, comma - selectionstart);
+				if (selection.empty() == false && selection[0] == '@'){
+					if (readManifest(selection.substr(1), selections) == false){
+						host.message("Manifest " + selection.substr(1) + " not found!");
+						return -1;
+					}
+				} else if (selection.empty() == false){
+					selections.push_back(selection);
+				}
+				selectionstart = comma + 1;
+			}
+			for (std::string& selection : selections){
+				if (selectors[packnumber].add(selection) == false){
+					host.message(selection + " isn't a valid regular expression!");
+					return -1;
+				}
+			}
+		}
+		packs.resize(shardspecs.size());
+		uint32_t leftoveramount = 0;
+		for (uint32_t modelnumber = 0; modelnumber < gmaindex.modelamount; modelnumber++){
+			size_t packnumber = 0;
+			while (packnumber < selectors.size() && selectors[packnumber].findRule(gmaindex.modelnames[modelnumber]) < 0){
+				packnumber++;
+			}
+			if (packnumber < selectors.size()){
+				packs[packnumber].modelnumbers.push_back(modelnumber);
+			} else {
+				leftoveramount++;
+			}
+		}
+		if (leftoveramount > 0){
+			host.message(std::to_string(leftoveramount) + " models weren't in any shard, so they've been left out.");
+		}
+	}
+	for (size_t packnumber = 0; packnumber < packs.size(); packnumber++){
+		packs[packnumber].outputname = filename + "_shard" + std::to_string(packnumber+1);
+	}
+	if (writeModelPacks(host, gma, tpl, gmaindex, tplindex, packs) == false){
+		host.message("Couldn't save the shards of " + filename + "!");
+		return -1;
+	}
+	for (ModelPack& pack : packs){
+		host.message(std::to_string(pack.modelnumbers.size()) + " models and " + std::to_string(pack.textureremap.oldtexturenumbers.size()) + " textures saved to " + pack.outputname);
+	}
+	return reportOverrun(host, filename, gma, tpl) ? -1 : 0;
+}
+
+/*
+Finds every stage in a directory, i.e. every <name>.gma with a <name>.tpl next to it.
+Files named <name>_<something> are skipped when <name> is also a stage, as they're what previous extractions saved.
+*/
+inline std::vector<std::string> findStages(std::string directoryname){
+	std::vector<std::filesystem::path> gmapaths;
+	std::unordered_set<std::string> stagenames;
+	std::error_code directoryerror;
+	for (const std::filesystem::directory_entry& entry : std::filesystem::directory_iterator(directoryname, directoryerror)){
+		std::filesystem::path gmapath = entry.path();
+		if (gmapath.extension() == ".gma" && std::filesystem::exists(std::filesystem::path(gmapath).replace_extension(".tpl"))){
+			gmapaths.push_back(gmapath);
+			stagenames.insert(gmapath.stem().string());
+		}
+	}
+	std::vector<std::string> stages;
+	for (std::filesystem::path& gmapath : gmapaths){
+		std::string stagename = gmapath.stem().string();
+		bool isoutput = false;
+		for (size_t underscore = stagename.find('_'); underscore != std::string::npos; underscore = stagename.find('_', underscore+1)){
+			if (stagenames.count(stagename.substr(0, underscore)) > 0){
+				isoutput = true;
+				break;
+			}
+		}
+		if (isoutput == false){
+			stages.push_back(gmapath.replace_extension("").string());
+		}
+	}
+	std::sort(stages.begin(), stages.end());
+	return stages;
+}
+
+inline int directoryExtract(Host& host, std::string directoryname, int type, unsigned int threadamount, std::string combinedsuffix){
+	std::vector<std::string> stages = findStages(directoryname);
+	if (stages.empty()){
+		host.message("No GMA and TPL pairs found in " + directoryname + "!");
+		return -1;
+	}
+	//whole stages are shared out between the threads, and each stage is extracted on a single thread
+	std::atomic<int> failedamount(0);
+	runJobs(stages.size(), threadamount, [&](size_t stagenumber){
+		if (modelExtract(host, stages[stagenumber], type, "", 1, combinedsuffix) != 0){
+			failedamount++;
+		}
+	});
+	if (failedamount > 0){
+		host.message(std::to_string(failedamount) + " of " + std::to_string(stages.size()) + " stages could not be extracted.");
+		return -1;
+	}
+	return 0;
+}
+
+/*
+
+Part 2:
+Model Merge
+
+*/
+
+/*
+Copies a model with every material's texture number passed through textureremap.
+Texture numbers past the end of the remap don't point to a texture, so they're just shifted up by textureshift.
+*/
+inline void putRemappedModel(OutputBuilder& newgma, const MappedFile& gma, const GmaIndex& gmaindex, uint32_t modelnumber, const std::vector<uint32_t>& textureremap, uint32_t textureshift){
+	PhaseTimer timer(remapphase);
+	uint64_t oldstartpoint = gmaindex.modelStart(modelnumber); //start of the model data
+	uint64_t oldendpoint = gmaindex.modelEnd(modelnumber);
+	uint16_t materialamount = gma.shortPluck(oldstartpoint+0x18);
+	newgma.putFrom(gma, oldstartpoint, 0x40);
+	uint64_t oldmodelheaderlength = 0x40;
+	//Loop for each material
+	for (uint32_t materialnumber = 0; materialnumber < materialamount; materialnumber++) {
+		newgma.putFrom(gma, oldstartpoint+0x40+0x20*materialnumber, 0x04);
+		uint16_t materialvalue = gma.shortPluck(oldstartpoint+0x44+0x20*materialnumber);
+		if (materialvalue < textureremap.size()){
+			newgma.putShort(textureremap[materialvalue]);
+		} else {
+			newgma.putShort(materialvalue + textureshift);
+		}
+		newgma.putFrom(gma, oldstartpoint+0x46+0x20*materialnumber, 0x1A);
+		oldmodelheaderlength += 0x20;
+	}
+	uint64_t oldmodeldatastart = oldstartpoint + oldmodelheaderlength;
+	uint64_t oldmodeldatalength = oldendpoint - oldmodeldatastart;
+	timer.switchTo(copyphase);
+	//rest of data
+	newgma.putFrom(gma, oldmodeldatastart, oldmodeldatalength);
+}
+
+/*
+Works out where every input's textures end up in a combined TPL.
+keptextures gets the input and texture number of everything that goes into the new TPL, in order.
+When deduplicating, a texture identical to one already kept points to that one instead, except in the first fixedinputamount inputs, which keep all of theirs.
+*/
+inline void remapTextures(const std::vector<MappedFile>& tpls, const std::vector<TplIndex>& tplindexes, bool deduplicate, size_t fixedinputamount, std::vector<std::vector<uint32_t>>& textureremaps, std::vector<std::pair<size_t, uint32_t>>& keptextures){
+	PhaseTimer timer(remapphase);
+	textureremaps.assign(tpls.size(), std::vector<uint32_t>());
+	keptextures.clear();
+	std::unordered_map<uint64_t, std::vector<uint32_t>> texturehashes; //new texture numbers for each hash
+	for (size_t inputnumber = 0; inputnumber < tpls.size(); inputnumber++){
+		const TplIndex& tplindex = tplindexes[inputnumber];
+		textureremaps[inputnumber].resize(tplindex.textureamount);
+		for (uint32_t texturenumber = 0; texturenumber < tplindex.textureamount; texturenumber++){
+			if (deduplicate){
+				std::vector<uint32_t>& samehashtextures = texturehashes[hashTexture(tpls[inputnumber], tplindex, texturenumber)];
+				bool isduplicate = false;
+				//a matching hash still gets a full comparison, just in case
+				for (uint32_t newtexturenumber : samehashtextures){
+					const std::pair<size_t, uint32_t>& keptexture = keptextures[newtexturenumber];
+					if (inputnumber >= fixedinputamount && isSameTexture(tpls[inputnumber], tplindex, texturenumber, tpls[keptexture.first], tplindexes[keptexture.first], keptexture.second)){
+						textureremaps[inputnumber][texturenumber] = newtexturenumber;
+						isduplicate = true;
+						break;
+					}
+				}
+				if (isduplicate){
+					continue;
+				}
+				samehashtextures.push_back(keptextures.size());
+			}
+			textureremaps[inputnumber][texturenumber] = keptextures.size();
+			keptextures.push_back({inputnumber, texturenumber});
+		}
+	}
+}
+
+/*
+The inputs of a merge or an append, opened and indexed, along with where each one's data ends up in the combined files.
+Every input's shifts are worked out before anything is written, so each input is read exactly once:
+- model data offsets go up by the length of all the model data before it
+- model name offsets go up by the length of all the name lists before it
+- texture numbers go up by the number of textures before it
+- texture offsets go up by the length of all the texture data before it, and by the change in header length
+The totals are for every input together, before any duplicate textures are dropped.
+Every input's indexes go in the arena, which can be given a block of memory to use instead of allocating its own.
+*/
+struct MergeInputs {
+	MergeInputs(){}
+	MergeInputs(void* arenablock, uint64_t arenalength) : arena(arenablock, arenalength) {}
+	IndexArena arena;
+	std::vector<std::string> filenames;
+	std::vector<MappedFile> gmas;
+	std::vector<MappedFile> tpls;
+	std::vector<GmaIndex> gmaindexes;
+	std::vector<TplIndex> tplindexes;
+	std::vector<uint64_t> datashifts;
+	std::vector<uint64_t> nameshifts;
+	std::vector<uint32_t> textureshifts;
+	std::vector<uint64_t> texturedatashifts;
+	uint64_t modelamount = 0;
+	uint64_t datalength = 0;
+	uint64_t namelistlength = 0;
+	uint64_t textureamount = 0;
+	uint64_t texturedatalength = 0;
+	size_t size() const {
+		return filenames.size();
+	}
+};
+
+inline bool openMergeInputs(Host& host, const std::vector<std::string>& filenames, MergeInputs& inputs){
+	size_t inputamount = filenames.size();
+	inputs.filenames = filenames;
+	inputs.gmas = std::vector<MappedFile>(inputamount);
+	inputs.tpls = std::vector<MappedFile>(inputamount);
+	inputs.gmaindexes.assign(inputamount, GmaIndex());
+	inputs.tplindexes.assign(inputamount, TplIndex());
+	inputs.datashifts.resize(inputamount);
+	inputs.nameshifts.resize(inputamount);
+	inputs.textureshifts.resize(inputamount);
+	inputs.texturedatashifts.resize(inputamount);
+	for (size_t inputnumber = 0; inputnumber < inputamount; inputnumber++){
+		if (openModelSource(host, filenames[inputnumber], inputs.gmas[inputnumber], inputs.tpls[inputnumber], inputs.arena, inputs.gmaindexes[inputnumber], inputs.tplindexes[inputnumber]) == false){
+			return false;
+		}
+		const GmaIndex& gmaindex = inputs.gmaindexes[inputnumber];
+		const TplIndex& tplindex = inputs.tplindexes[inputnumber];
+		inputs.datashifts[inputnumber] = inputs.datalength;
+		inputs.nameshifts[inputnumber] = inputs.namelistlength;
+		inputs.textureshifts[inputnumber] = inputs.textureamount;
+		inputs.texturedatashifts[inputnumber] = inputs.texturedatalength;
+		inputs.modelamount += gmaindex.modelamount;
+		inputs.datalength += gmaindex.filelength - gmaindex.headerlength;
+		inputs.namelistlength += gmaindex.namelistLength();
+		inputs.textureamount += tplindex.textureamount;
+		if (tplindex.textureamount != 0){
+			inputs.texturedatalength += tplindex.filelength - tplindex.headerLength();
+		}
+	}
+	return true;
+}
+
+/*
+"a, b and c", for saying what's being merged.
+*/
+inline std::string listInputs(const MergeInputs& inputs, size_t firstinputnumber){
+	std::string list;
+	for (size_t inputnumber = firstinputnumber; inputnumber < inputs.size(); inputnumber++){
+		if (inputnumber > firstinputnumber){
+			list += (inputnumber+1 == inputs.size()) ? " and " : ", ";
+		}
+		list += inputs.filenames[inputnumber];
+	}
+	return list;
+}
+
+/*
+Writes the GMA model offset tables of every input from firstinputnumber on, one after the other, each shifted past the inputs before it.
+Every model's offsets need the same shift, so it's done to each input's whole table at once.
+*/
+inline void putShiftedOffsetTables(OutputBuilder& newgma, const MergeInputs& inputs, size_t firstinputnumber){
+	uint64_t tablelength = 0;
+	for (size_t inputnumber = firstinputnumber; inputnumber < inputs.size(); inputnumber++){
+		tablelength += 0x08*uint64_t(inputs.gmaindexes[inputnumber].modelamount);
+	}
+	std::vector<unsigned char> newgmaoffsettable(tablelength);
+	uint64_t offsettableposition = 0;
+	for (size_t inputnumber = firstinputnumber; inputnumber < inputs.size(); inputnumber++){
+		const GmaIndex& gmaindex = inputs.gmaindexes[inputnumber];
+		const uint32_t shifts[4] = {uint32_t(inputs.datashifts[inputnumber]), uint32_t(inputs.nameshifts[inputnumber]), uint32_t(inputs.datashifts[inputnumber]), uint32_t(inputs.nameshifts[inputnumber])};
+		addToBigInts(inputs.gmas[inputnumber].data() + 0x08, newgmaoffsettable.data() + offsettableposition, 0x02*uint64_t(gmaindex.modelamount), shifts);
+		offsettableposition += 0x08*uint64_t(gmaindex.modelamount);
+	}
+	newgma.putBytes(newgmaoffsettable.data(), newgmaoffsettable.size());
+}
+
+inline bool reportOverruns(Host& host, const MergeInputs& inputs){
+	for (size_t inputnumber = 0; inputnumber < inputs.size(); inputnumber++){
+		if (reportOverrun(host, inputs.filenames[inputnumber], inputs.gmas[inputnumber], inputs.tpls[inputnumber])){
+			return true;
+		}
+	}
+	return false;
+}
+
+inline int gmatplMerge(Host& host, MergeInputs& inputs, std::string outputname, bool deduplicate){
+	/*
+	Every input's data goes after the ones before it, shifted as worked out by openMergeInputs.
+	When deduplicating, textures that are identical to one already kept are dropped, and any materials using them are pointed at the kept copy instead.
+	*/
+	size_t inputamount = inputs.size();
+	host.message("Merging GMAs and TPLs " + listInputs(inputs, 0) + "...");
+	uint64_t newgmamodelamount = inputs.modelamount;
+	uint64_t newgmadatalength = inputs.datalength;
+	uint64_t newtpltextureamount = inputs.textureamount;
+	uint64_t newtpldatalength = inputs.texturedatalength;
+	//Work out where every input's textures end up
+	std::vector<std::vector<uint32_t>> textureremaps;
+	std::vector<std::pair<size_t, uint32_t>> keptextures;
+	remapTextures(inputs.tpls, inputs.tplindexes, deduplicate, 0, textureremaps, keptextures);
+	if (deduplicate){
+		host.message("Removed " + std::to_string(newtpltextureamount - keptextures.size()) + " duplicate textures.");
+		newtpltextureamount = keptextures.size();
+		newtpldatalength = 0;
+		for (const std::pair<size_t, uint32_t>& keptexture : keptextures){
+			newtpldatalength += inputs.tplindexes[keptexture.first].textureEnd(keptexture.second) - inputs.tplindexes[keptexture.first].textureStart(keptexture.second);
+		}
+	}
+	//The pure header length is the initial bytes, plus the 8 times the number of of models, plus the sum of the lengths of the model name lists
+	uint64_t newgmapureheaderlength = 0x8 + newgmamodelamount*0x8 + inputs.namelistlength;
+	uint64_t newgmaheaderpadding = (-newgmapureheaderlength) % 0x20; //to pad it to 20
+	uint64_t newgmaheaderlength = newgmapureheaderlength + newgmaheaderpadding;
+	uint64_t newtplheaderlength = tplHeaderLength(newtpltextureamount);
+	std::string toobig = checkOutputLimits(newgmaheaderlength, newgmadatalength, newtpltextureamount, newtplheaderlength + newtpldatalength);
+	if (toobig.empty() == false){
+		host.message(outputname + " would be too big to save, as " + toobig + "!");
+		return -1;
+	}
+	PhaseTimer timer(headerphase);
+	//First the GMA.
+	//append number of models
+	OutputBuilder newgma;
+	if (host.openOutput(newgma, outputname + ".gma") == false){
+		host.message("Couldn't create " + outputname + ".gma!");
+		return -1;
+	}
+	newgma.putInt(newgmamodelamount);
+	newgma.putInt(newgmaheaderlength);
+	putShiftedOffsetTables(newgma, inputs, 0);
+	//Model name lists
+	for (size_t inputnumber = 0; inputnumber < inputamount; inputnumber++){
+		newgma.putFrom(inputs.gmas[inputnumber], inputs.gmaindexes[inputnumber].nameliststart, inputs.gmaindexes[inputnumber].namelistLength());
+	}
+	//Padding
+	newgma.putZeroes(newgmaheaderpadding);
+	//Model data
+	timer.switchTo(copyphase);
+	for (size_t inputnumber = 0; inputnumber < inputamount; inputnumber++){
+		const MappedFile& gma = inputs.gmas[inputnumber];
+		const GmaIndex& gmaindex = inputs.gmaindexes[inputnumber];
+		const std::vector<uint32_t>& textureremap = textureremaps[inputnumber];
+		bool istextureremapped = false;
+		for (uint32_t texturenumber = 0; texturenumber < textureremap.size(); texturenumber++){
+			istextureremapped = istextureremapped || (textureremap[texturenumber] != texturenumber);
+		}
+		if (istextureremapped == false && (inputs.textureshifts[inputnumber] == 0 || deduplicate)){
+			//None of its textures have moved, so it can all be copied over.
+			newgma.putFrom(gma, gmaindex.headerlength, gmaindex.filelength - gmaindex.headerlength);
+			continue;
+		}
+		//Otherwise the model data needs all of its textures moved
+		for (uint32_t modelnumber = 0; modelnumber < gmaindex.modelamount; modelnumber++){
+			putRemappedModel(newgma, gma, gmaindex, modelnumber, textureremap, inputs.textureshifts[inputnumber]);
+		}
+	}
+	//we're done here
+	if (newgma.close() == false){
+		host.message("Couldn't save " + outputname + ".gma!");
+		return -1;
+	}
+	//Now for the TPL
+	timer.switchTo(tplphase);
+	OutputBuilder newtpl;
+	if (host.openOutput(newtpl, outputname + ".tpl") == false){
+		host.message("Couldn't create " + outputname + ".tpl!");
+		return -1;
+	}
+	//we can write the first byte straight away
+	newtpl.putInt(newtpltextureamount);
+	if (deduplicate){
+		//only the kept textures are written, one after another
+		uint64_t rollingoffset = newtplheaderlength;
+		for (const std::pair<size_t, uint32_t>& keptexture : keptextures){
+			const TplIndex& tplindex = inputs.tplindexes[keptexture.first];
+			uint64_t oldtextureheaderpos = tplindex.headerPosition(keptexture.second);
+			newtpl.putFrom(inputs.tpls[keptexture.first], oldtextureheaderpos, 0x04);
+			newtpl.putInt(rollingoffset);
+			newtpl.putFrom(inputs.tpls[keptexture.first], oldtextureheaderpos+0x08, 0x08);
+			rollingoffset += tplindex.textureEnd(keptexture.second) - tplindex.textureStart(keptexture.second);
+		}
+		newtpl.putZeroes(newtplheaderlength - newtpl.size());
+		for (const std::pair<size_t, uint32_t>& keptexture : keptextures){
+			const TplIndex& tplindex = inputs.tplindexes[keptexture.first];
+			newtpl.putFrom(inputs.tpls[keptexture.first], tplindex.textureStart(keptexture.second), tplindex.textureEnd(keptexture.second) - tplindex.textureStart(keptexture.second));
+		}
+	} else {
+		//each input's texture entries are copied over whole, with only their data offsets moved
+		std::vector<unsigned char> newtplentries(0x10*uint64_t(newtpltextureamount));
+		uint64_t entryposition = 0;
+		for (size_t inputnumber = 0; inputnumber < inputamount; inputnumber++){
+			const TplIndex& tplindex = inputs.tplindexes[inputnumber];
+			const uint32_t shifts[4] = {0, uint32_t(newtplheaderlength + inputs.texturedatashifts[inputnumber] - tplindex.headerLength()), 0, 0};
+			addToBigInts(inputs.tpls[inputnumber].data() + tplindex.headerPosition(0), newtplentries.data() + entryposition, 0x04*uint64_t(tplindex.textureamount), shifts);
+			entryposition += 0x10*uint64_t(tplindex.textureamount);
+		}
+		newtpl.putBytes(newtplentries.data(), newtplentries.size());
+		newtpl.putZeroes(newtplheaderlength - newtpl.size());
+		//remaining data bytes
+		timer.switchTo(copyphase);
+		for (size_t inputnumber = 0; inputnumber < inputamount; inputnumber++){
+			const TplIndex& tplindex = inputs.tplindexes[inputnumber];
+			if (tplindex.textureamount != 0){
+				newtpl.putFrom(inputs.tpls[inputnumber], tplindex.headerLength(), tplindex.filelength - tplindex.headerLength());
+			}
+		}
+	}
+	if (newtpl.close() == false){
+		host.message("Couldn't save " + outputname + ".tpl!");
+		return -1;
+	}
+	return reportOverruns(host, inputs) ? -1 : 0;
+}
+
+inline int gmatplMerge(Host& host, std::vector<std::string> filenames, std::string outputname, bool deduplicate){
+	MergeInputs inputs;
+	if (openMergeInputs(host, filenames, inputs) == false){
+		return -1;
+	}
+	return gmatplMerge(host, inputs, outputname, deduplicate);
+}
+
+/*
+Moves the bytes from start to end of a file up by shift, writing them back into the same file through newfile.
+It works backwards one chunk at a time, so nothing is overwritten before it's been read.
+*/
+inline bool shiftFileData(OutputBuilder& newfile, const MappedFile& bif, uint64_t start, uint64_t end, uint64_t shift){
+	const uint64_t chunklength = 0x100000;
+	std::vector<unsigned char> chunk;
+	while (end > start && shift > 0){
+		uint64_t chunkstart = (end - start > chunklength) ? end - chunklength : start;
+		chunk.assign(bif.data() + chunkstart, bif.data() + end);
+		if (newfile.seek(chunkstart + shift) == false){
+			return false;
+		}
+		newfile.putBytes(chunk.data(), chunk.size());
+		if (newfile.flush() == false){
+			return false;
+		}
+		end = chunkstart;
+	}
+	return true;
+}
+
+inline int gmatplAppend(Host& host, std::string targetname, std::vector<std::string> filenames, bool deduplicate){
+	/*
+	Adds models and textures onto the end of an existing GMA and TPL, without rewriting what's already there.
+	Only the headers are rewritten. The existing data only moves if the bigger header doesn't fit in the old one's padding, and then it's shifted up in one go.
+	The target is input 0, so it's indexed just like a merge, but its textures are never dropped as duplicates.
+	*/
+	filenames.insert(filenames.begin(), targetname);
+	MergeInputs inputs;
+	if (openMergeInputs(host, filenames, inputs) == false){
+		return -1;
+	}
+	size_t inputamount = inputs.size();
+	for (size_t inputnumber = 1; inputnumber < inputamount; inputnumber++){
+		std::error_code filesystemerror;
+		if (std::filesystem::equivalent(filenames[inputnumber] + ".gma", targetname + ".gma", filesystemerror) || std::filesystem::equivalent(filenames[inputnumber] + ".tpl", targetname + ".tpl", filesystemerror)){
+			host.message("Can't append " + targetname + " to itself!");
+			return -1;
+		}
+	}
+	host.message("Appending " + listInputs(inputs, 1) + " to " + targetname + "...");
+	const std::vector<MappedFile>& gmas = inputs.gmas;
+	const std::vector<MappedFile>& tpls = inputs.tpls;
+	const std::vector<GmaIndex>& gmaindexes = inputs.gmaindexes;
+	const std::vector<TplIndex>& tplindexes = inputs.tplindexes;
+	uint64_t newgmamodelamount = inputs.modelamount;
+	uint64_t newgmadatalength = inputs.datalength;
+	uint64_t newtpltextureamount = inputs.textureamount;
+	std::vector<std::vector<uint32_t>> textureremaps;
+	std::vector<std::pair<size_t, uint32_t>> keptextures;
+	remapTextures(tpls, tplindexes, deduplicate, 1, textureremaps, keptextures);
+	if (deduplicate){
+		host.message("Removed " + std::to_string(newtpltextureamount - keptextures.size()) + " duplicate textures.");
+		newtpltextureamount = keptextures.size();
+	}
+	//The headers are rewritten from copies, as the files underneath them are about to change
+	const MappedFile& targetgma = gmas[0];
+	const GmaIndex& targetgmaindex = gmaindexes[0];
+	std::vector<unsigned char> oldgmaheader(targetgma.data(), targetgma.data() + targetgmaindex.namelistend);
+	uint64_t newgmapureheaderlength = 0x8 + newgmamodelamount*0x8 + inputs.namelistlength;
+	uint64_t newgmaheaderlength = std::max<uint64_t>(newgmapureheaderlength + (-newgmapureheaderlength) % 0x20, targetgmaindex.headerlength);
+	const MappedFile& targettpl = tpls[0];
+	const TplIndex& targettplindex = tplindexes[0];
+	uint64_t oldtpldatalength = (targettplindex.textureamount != 0) ? targettplindex.filelength - targettplindex.headerLength() : 0;
+	uint64_t newtplheaderlength = std::max<uint64_t>(tplHeaderLength(newtpltextureamount), targettplindex.headerLength());
+	uint64_t newtpldatalength = oldtpldatalength;
+	for (size_t keptexturenumber = targettplindex.textureamount; keptexturenumber < keptextures.size(); keptexturenumber++){
+		const std::pair<size_t, uint32_t>& keptexture = keptextures[keptexturenumber];
+		newtpldatalength += tplindexes[keptexture.first].textureEnd(keptexture.second) - tplindexes[keptexture.first].textureStart(keptexture.second);
+	}
+	std::string toobig = checkOutputLimits(newgmaheaderlength, newgmadatalength, newtpltextureamount, newtplheaderlength + newtpldatalength);
+	if (toobig.empty() == false){
+		host.message("Can't append to " + targetname + ", as " + toobig + "!");
+		return -1;
+	}
+	//First the GMA.
+	PhaseTimer timer(copyphase);
+	OutputBuilder newgma;
+	if (newgma.openExisting(targetname + ".gma") == false){
+		host.message("Couldn't open " + targetname + ".gma for writing!");
+		return -1;
+	}
+	//Make room for the bigger header, if it doesn't fit already
+	if (shiftFileData(newgma, targetgma, targetgmaindex.headerlength, targetgmaindex.filelength, newgmaheaderlength - targetgmaindex.headerlength) == false){
+		host.message("Couldn't save " + targetname + ".gma!");
+		return -1;
+	}
+	//New models go after the existing ones
+	timer.switchTo(copyphase);
+	newgma.seek(newgmaheaderlength + targetgmaindex.filelength - targetgmaindex.headerlength);
+	for (size_t inputnumber = 1; inputnumber < inputamount; inputnumber++){
+		for (uint32_t modelnumber = 0; modelnumber < gmaindexes[inputnumber].modelamount; modelnumber++){
+			putRemappedModel(newgma, gmas[inputnumber], gmaindexes[inputnumber], modelnumber, textureremaps[inputnumber], inputs.textureshifts[inputnumber]);
+		}
+	}
+	//Then the header over the top of the old one
+	timer.switchTo(headerphase);
+	newgma.seek(0);
+	newgma.putInt(newgmamodelamount);
+	newgma.putInt(newgmaheaderlength);
+	newgma.putBytes(oldgmaheader.data() + 0x8, targetgmaindex.modelamount*0x8);
+	putShiftedOffsetTables(newgma, inputs, 1);
+	newgma.putBytes(oldgmaheader.data() + targetgmaindex.nameliststart, targetgmaindex.namelistLength());
+	for (size_t inputnumber = 1; inputnumber < inputamount; inputnumber++){
+		newgma.putFrom(gmas[inputnumber], gmaindexes[inputnumber].nameliststart, gmaindexes[inputnumber].namelistLength());
+	}
+	newgma.putZeroes(newgmaheaderlength - newgma.size());
+	if (newgma.close() == false){
+		host.message("Couldn't save " + targetname + ".gma!");
+		return -1;
+	}
+	//Now for the TPL
+	timer.switchTo(tplphase);
+	std::vector<unsigned char> oldtplheader(targettpl.data(), targettpl.data() + targettplindex.headerPosition(targettplindex.textureamount));
+	uint32_t tplheadershift = newtplheaderlength - targettplindex.headerLength();
+	OutputBuilder newtpl;
+	if (newtpl.openExisting(targetname + ".tpl") == false){
+		host.message("Couldn't open " + targetname + ".tpl for writing!");
+		return -1;
+	}
+	if (shiftFileData(newtpl, targettpl, targettplindex.headerLength(), targettplindex.headerLength() + oldtpldatalength, tplheadershift) == false){
+		host.message("Couldn't save " + targetname + ".tpl!");
+		return -1;
+	}
+	//New textures go after the existing ones
+	timer.switchTo(copyphase);
+	newtpl.seek(newtplheaderlength + oldtpldatalength);
+	std::vector<uint64_t> newtextureoffsets;
+	for (size_t keptexturenumber = targettplindex.textureamount; keptexturenumber < keptextures.size(); keptexturenumber++){
+		const std::pair<size_t, uint32_t>& keptexture = keptextures[keptexturenumber];
+		const TplIndex& tplindex = tplindexes[keptexture.first];
+		newtextureoffsets.push_back(newtpl.size());
+		newtpl.putFrom(tpls[keptexture.first], tplindex.textureStart(keptexture.second), tplindex.textureEnd(keptexture.second) - tplindex.textureStart(keptexture.second));
+	}
+	timer.switchTo(tplphase);
+	newtpl.seek(0);
+	newtpl.putInt(newtpltextureamount);
+	//the existing entries only need their data offsets moved past the longer header
+	const uint32_t shifts[4] = {0, tplheadershift, 0, 0};
+	addToBigInts(oldtplheader.data() + 0x04, oldtplheader.data() + 0x04, 0x04*uint64_t(targettplindex.textureamount), shifts);
+	newtpl.putBytes(oldtplheader.data() + 0x04, 0x10*uint64_t(targettplindex.textureamount));
+	for (size_t keptexturenumber = targettplindex.textureamount; keptexturenumber < keptextures.size(); keptexturenumber++){
+		const std::pair<size_t, uint32_t>& keptexture = keptextures[keptexturenumber];
+		uint64_t oldtextureheaderpos = tplindexes[keptexture.first].headerPosition(keptexture.second);
+		newtpl.putFrom(tpls[keptexture.first], oldtextureheaderpos, 0x04);
+		newtpl.putInt(newtextureoffsets[keptexturenumber - targettplindex.textureamount]);
+		newtpl.putFrom(tpls[keptexture.first], oldtextureheaderpos+0x08, 0x08);
+	}
+	newtpl.putZeroes(newtplheaderlength - newtpl.size());
+	if (newtpl.close() == false){
+		host.message("Couldn't save " + targetname + ".tpl!");
+		return -1;
+	}
+	return reportOverruns(host, inputs) ? -1 : 0;
+}
+
+/*
+
+Part 4:
+Asset index
+
+*/
+
+/*
+Everything the asset index keeps about a stage, so queries don't have to open it again.
+Each stage is keyed by its path, and by the size and modification time of its GMA and TPL, so anything that has changed since gets indexed again.
+*/
+struct IndexedModel {
+	std::string name;
+	uint64_t datastart = 0;
+	uint64_t dataend = 0;
+	std::vector<uint16_t> texturenumbers; //one for each material
+};
+
+struct IndexedStage {
+	std::string path;
+	uint64_t gmalength = 0;
+	uint64_t gmatime = 0;
+	uint64_t tpllength = 0;
+	uint64_t tpltime = 0;
+	uint64_t gmaheaderlength = 0;
+	std::vector<IndexedModel> models;
+	std::vector<uint64_t> textureoffsets;
+	uint64_t tplfilelength = 0;
+};
+
+inline bool getStageStamp(std::string path, uint64_t& gmalength, uint64_t& gmatime, uint64_t& tpllength, uint64_t& tpltime){
+	std::error_code fileerror;
+	gmalength = std::filesystem::file_size(path + ".gma", fileerror);
+	if (fileerror){
+		return false;
+	}
+	gmatime = std::filesystem::last_write_time(path + ".gma", fileerror).time_since_epoch().count();
+	if (fileerror){
+		return false;
+	}
+	tpllength = std::filesystem::file_size(path + ".tpl", fileerror);
+	if (fileerror){
+		return false;
+	}
+	tpltime = std::filesystem::last_write_time(path + ".tpl", fileerror).time_since_epoch().count();
+	return !fileerror;
+}
+
+inline bool isStageCurrent(const IndexedStage& stage){
+	uint64_t gmalength, gmatime, tpllength, tpltime;
+	if (getStageStamp(stage.path, gmalength, gmatime, tpllength, tpltime) == false){
+		return false;
+	}
+	return gmalength == stage.gmalength && gmatime == stage.gmatime && tpllength == stage.tpllength && tpltime == stage.tpltime;
+}
+
+inline bool indexStage(Host& host, std::string path, IndexedStage& stage){
+	stage = IndexedStage();
+	stage.path = path;
+	if (getStageStamp(path, stage.gmalength, stage.gmatime, stage.tpllength, stage.tpltime) == false){
+		host.message("No GMA and TPL pair found at " + path + "!");
+		return false;
+	}
+	MappedFile gma;
+	MappedFile tpl;
+	IndexArena arena;
+	GmaIndex gmaindex;
+	TplIndex tplindex;
+	if (openModelSource(host, path, gma, tpl, arena, gmaindex, tplindex) == false){
+		return false;
+	}
+	stage.gmaheaderlength = gmaindex.headerlength;
+	stage.models.resize(gmaindex.modelamount);
+	for (uint32_t modelnumber = 0; modelnumber < gmaindex.modelamount; modelnumber++){
+		IndexedModel& model = stage.models[modelnumber];
+		model.name = std::string(gmaindex.modelnames[modelnumber]);
+		model.datastart = gmaindex.modelStart(modelnumber);
+		model.dataend = gmaindex.modelEnd(modelnumber);
+		uint16_t materialamount = gma.shortPluck(model.datastart+0x18);
+		model.texturenumbers.resize(materialamount);
+		for (uint32_t materialnumber = 0; materialnumber < materialamount; materialnumber++){
+			model.texturenumbers[materialnumber] = gma.shortPluck(model.datastart+0x44+0x20*materialnumber);
+		}
+	}
+	stage.textureoffsets.assign(tplindex.textureoffsets, tplindex.textureoffsets + tplindex.textureamount);
+	stage.tplfilelength = tplindex.filelength;
+	return reportOverrun(host, path, gma, tpl) == false;
+}
+
+/*
+Rebuilds the GMA and TPL indexes from the asset index, so a cached stage can be extracted from without parsing its headers again.
+Model data offsets go back to being relative to the end of the header, as they are in the GMA, so they still fit in 32 bits when the whole file doesn't. The name views point into the asset index.
+Returns false if the arena has run out.
+*/
+inline bool restoreIndexes(const IndexedStage& stage, IndexArena& arena, GmaIndex& gmaindex, TplIndex& tplindex){
+	gmaindex = GmaIndex();
+	gmaindex.modelamount = stage.models.size();
+	gmaindex.headerlength = stage.gmaheaderlength;
+	gmaindex.filelength = stage.gmalength;
+	gmaindex.dataoffsets = arena.take<uint32_t>(gmaindex.modelamount);
+	gmaindex.modelnames = arena.take<std::string_view>(gmaindex.modelamount);
+	tplindex = TplIndex();
+	tplindex.textureamount = stage.textureoffsets.size();
+	tplindex.filelength = stage.tplfilelength;
+	tplindex.textureoffsets = arena.take<uint32_t>(tplindex.textureamount);
+	if (gmaindex.dataoffsets == nullptr || gmaindex.modelnames == nullptr || tplindex.textureoffsets == nullptr){
+		return false;
+	}
+	for (uint32_t modelnumber = 0; modelnumber < gmaindex.modelamount; modelnumber++){
+		gmaindex.dataoffsets[modelnumber] = stage.models[modelnumber].datastart - stage.gmaheaderlength;
+		gmaindex.modelnames[modelnumber] = stage.models[modelnumber].name;
+	}
+	std::copy(stage.textureoffsets.begin(), stage.textureoffsets.end(), tplindex.textureoffsets);
+	return true;
+}
+
+/*
+The asset index file starts with "GMAI", a version number and the number of stages.
+Each stage is then its path, the sizes and times of its GMA and TPL, the length of its GMA header, its models (name, data start and end, and texture numbers), and its texture offsets.
+Everything is big endian, and strings are a 4 byte length followed by the characters.
+*/
+const uint32_t assetindexversion = 2;
+
+inline bool readAssetIndex(std::string indexname, std::vector<IndexedStage>& stages){
+	stages.clear();
+	MappedFile indexfile;
+	if (indexfile.open(indexname) == false){
+		//nothing indexed yet
+		return true;
+	}
+	uint64_t position = 0;
+	auto readInt = [&](){
+		position += 0x4;
+		return indexfile.intPluck(position - 0x4);
+	};
+	auto readLong = [&](){
+		uint64_t value = uint64_t(readInt()) << 32;
+		return value | readInt();
+	};
+	auto readString = [&](){
+		uint32_t stringlength = readInt();
+		if (indexfile.inBounds(position, stringlength) == false){
+			indexfile.markOverrun();
+			return std::string();
+		}
+		position += stringlength;
+		return std::string(reinterpret_cast<const char*>(indexfile.data()) + position - stringlength, stringlength);
+	};
+	if (readInt() != 0x474D4149 || readInt() != assetindexversion){
+		return false;
+	}
+	uint32_t stageamount = readInt();
+	for (uint32_t stagenumber = 0; stagenumber < stageamount && indexfile.overrun() == false; stagenumber++){
+		IndexedStage stage;
+		stage.path = readString();
+		stage.gmalength = readLong();
+		stage.gmatime = readLong();
+		stage.tpllength = readLong();
+		stage.tpltime = readLong();
+		stage.gmaheaderlength = readLong();
+		uint32_t modelamount = readInt();
+		for (uint32_t modelnumber = 0; modelnumber < modelamount && indexfile.overrun() == false; modelnumber++){
+			IndexedModel model;
+			model.name = readString();
+			model.datastart = readLong();
+			model.dataend = readLong();
+			uint32_t materialamount = readInt();
+			for (uint32_t materialnumber = 0; materialnumber < materialamount && indexfile.overrun() == false; materialnumber++){
+				model.texturenumbers.push_back(indexfile.shortPluck(position));
+				position += 0x2;
+			}
+			stage.models.push_back(model);
+		}
+		uint32_t textureamount = readInt();
+		for (uint32_t texturenumber = 0; texturenumber < textureamount && indexfile.overrun() == false; texturenumber++){
+			stage.textureoffsets.push_back(readLong());
+		}
+		stage.tplfilelength = readLong();
+		stages.push_back(stage);
+	}
+	if (indexfile.overrun()){
+		stages.clear();
+		return false;
+	}
+	return true;
+}
+
+inline bool writeAssetIndex(std::string indexname, const std::vector<IndexedStage>& stages){
+	//the index is a cache of what's on disk, so it always goes straight to disk rather than through a host
+	OutputBuilder indexfile;
+	if (indexfile.open(indexname) == false){
+		return false;
+	}
+	auto putLong = [&](uint64_t value){
+		indexfile.putInt(value >> 32);
+		indexfile.putInt(value);
+	};
+	auto putString = [&](const std::string& value){
+		indexfile.putInt(value.length());
+		indexfile.putBytes(value.data(), value.length());
+	};
+	indexfile.putInt(0x474D4149); //GMAI
+	indexfile.putInt(assetindexversion);
+	indexfile.putInt(stages.size());
+	for (const IndexedStage& stage : stages){
+		putString(stage.path);
+		putLong(stage.gmalength);
+		putLong(stage.gmatime);
+		putLong(stage.tpllength);
+		putLong(stage.tpltime);
+		putLong(stage.gmaheaderlength);
+		indexfile.putInt(stage.models.size());
+		for (const IndexedModel& model : stage.models){
+			putString(model.name);
+			putLong(model.datastart);
+			putLong(model.dataend);
+			indexfile.putInt(model.texturenumbers.size());
+			for (uint16_t texturenumber : model.texturenumbers){
+				indexfile.putShort(texturenumber);
+			}
+		}
+		indexfile.putInt(stage.textureoffsets.size());
+		for (uint64_t textureoffset : stage.textureoffsets){
+			putLong(textureoffset);
+		}
+		putLong(stage.tplfilelength);
+	}
+	return indexfile.close();
+}
+
+/*
+Indexes the given stages again, if they've changed since they were last indexed.
+Stages that can't be indexed (usually because they've been deleted or moved) are dropped from the index, which changes the stage numbers.
+Returns how many were indexed again, and sets droppedamount to how many were dropped.
+*/
+inline int refreshAssetIndex(Host& host, std::vector<IndexedStage>& stages, const std::vector<size_t>& stagenumbers, unsigned int threadamount, size_t& droppedamount){
+	std::vector<size_t> changedstagenumbers;
+	for (size_t stagenumber : stagenumbers){
+		if (isStageCurrent(stages[stagenumber]) == false){
+			changedstagenumbers.push_back(stagenumber);
+		}
+	}
+	//a stage can be asked for more than once, but it's only indexed once
+	std::sort(changedstagenumbers.begin(), changedstagenumbers.end());
+	changedstagenumbers.erase(std::unique(changedstagenumbers.begin(), changedstagenumbers.end()), changedstagenumbers.end());
+	//chars rather than bools, as each thread sets its own
+	std::vector<char> isdropped(stages.size(), false);
+	runJobs(changedstagenumbers.size(), threadamount, [&](size_t jobnumber){
+		size_t stagenumber = changedstagenumbers[jobnumber];
+		std::string path = stages[stagenumber].path;
+		if (indexStage(host, path, stages[stagenumber]) == false){
+			host.message(path + " couldn't be indexed, so it's been dropped from the index.");
+			isdropped[stagenumber] = true;
+		}
+	});
+	size_t keptamount = 0;
+	for (size_t stagenumber = 0; stagenumber < stages.size(); stagenumber++){
+		if (isdropped[stagenumber] == false){
+			if (keptamount != stagenumber){
+				stages[keptamount] = std::move(stages[stagenumber]);
+			}
+			keptamount++;
+		}
+	}
+	droppedamount = stages.size() - keptamount;
+	stages.resize(keptamount);
+	return changedstagenumbers.size() - droppedamount;
+}
+
+inline int buildAssetIndex(Host& host, std::string indexname, std::vector<std::string> paths, unsigned int threadamount){
+	/*
+	Adds stages to the asset index, or updates them if they've changed. Directories add every stage in them.
+	Stages already in the index that haven't changed are kept as they are without being opened.
+	*/
+	std::vector<IndexedStage> stages;
+	if (readAssetIndex(indexname, stages) == false){
+		host.message("The asset index " + indexname + " is corrupt or out of date, so it'll be rebuilt.");
+	}
+	std::unordered_map<std::string, size_t> stagenumbers;
+	for (size_t stagenumber = 0; stagenumber < stages.size(); stagenumber++){
+		stagenumbers.emplace(stages[stagenumber].path, stagenumber);
+	}
+	std::vector<size_t> requestedstagenumbers;
+	for (std::string& path : paths){
+		std::vector<std::string> stagepaths = std::filesystem::is_directory(path) ? findStages(path) : std::vector<std::string>{path};
+		for (std::string& stagepath : stagepaths){
+			//stages are keyed by their full path, so the index works from anywhere
+			std::string fullpath = std::filesystem::absolute(stagepath).lexically_normal().string();
+			auto found = stagenumbers.try_emplace(fullpath, stages.size());
+			if (found.second){
+				stages.push_back(IndexedStage());
+				stages.back().path = fullpath;
+			}
+			requestedstagenumbers.push_back(found.first->second);
+		}
+	}
+	size_t droppedamount = 0;
+	int changedamount = refreshAssetIndex(host, stages, requestedstagenumbers, threadamount, droppedamount);
+	if (writeAssetIndex(indexname, stages) == false){
+		host.message("Couldn't save " + indexname + "!");
+		return -1;
+	}
+	host.message("Indexed " + std::to_string(changedamount) + " stages, " + std::to_string(requestedstagenumbers.size() - changedamount - droppedamount) + " unchanged. " + indexname + " has " + std::to_string(stages.size()) + " stages.");
+	return (droppedamount > 0) ? -1 : 0;
+}
+
+inline int queryAssetIndex(Host& host, std::string indexname, std::vector<std::string> patterns, bool extract, unsigned int threadamount, std::string combinedsuffix){
+	/*
+	Finds every model in the asset index matching any of the patterns, which are the same as -be's.
+	Every stage is checked against the disk first, and indexed again if it's changed, so a stage that's gained a match isn't missed. Checking is only a stat, so it's cheap next to indexing.
+	When extracting, each stage with a match is extracted from using the indexed headers rather than parsing its own.
+	*/
+	std::vector<IndexedStage> stages;
+	if (readAssetIndex(indexname, stages) == false || stages.empty()){
+		host.message("The asset index " + indexname + " is missing or corrupt! Build it with -index first.");
+		return -1;
+	}
+	ModelSelector selector;
+	for (std::string& pattern : patterns){
+		if (selector.add(pattern) == false){
+			host.message(pattern + " isn't a valid regular expression!");
+			return -1;
+		}
+	}
+	auto findMatches = [&](const IndexedStage& stage){
+		std::vector<uint32_t> matches;
+		for (uint32_t modelnumber = 0; modelnumber < stage.models.size(); modelnumber++){
+			if (selector.findRule(stage.models[modelnumber].name) >= 0){
+				matches.push_back(modelnumber);
+			}
+		}
+		return matches;
+	};
+	std::vector<size_t> allstagenumbers(stages.size());
+	for (size_t stagenumber = 0; stagenumber < stages.size(); stagenumber++){
+		allstagenumbers[stagenumber] = stagenumber;
+	}
+	size_t droppedamount = 0;
+	int changedamount = refreshAssetIndex(host, stages, allstagenumbers, threadamount, droppedamount);
+	if ((changedamount > 0 || droppedamount > 0) && writeAssetIndex(indexname, stages) == false){
+		host.message("Couldn't save " + indexname + "!");
+		return -1;
+	}
+	std::vector<size_t> matchingstagenumbers;
+	for (size_t stagenumber = 0; stagenumber < stages.size(); stagenumber++){
+		if (findMatches(stages[stagenumber]).empty() == false){
+			matchingstagenumbers.push_back(stagenumber);
+		}
+	}
+	int successval = 0;
+	uint64_t matchamount = 0;
+	//stages are extracted from one at a time, so they can all share one arena
+	IndexArena arena;
+	for (size_t stagenumber : matchingstagenumbers){
+		const IndexedStage& stage = stages[stagenumber];
+		std::vector<uint32_t> matches = findMatches(stage);
+		matchamount += matches.size();
+		if (extract){
+			if (matches.empty()){
+				continue;
+			}
+			MappedFile gma;
+			MappedFile tpl;
+			GmaIndex gmaindex;
+			TplIndex tplindex;
+			if (host.openInput(gma, stage.path + ".gma") == false || host.openInput(tpl, stage.path + ".tpl") == false){
+				host.message("Couldn't open " + stage.path + "!");
+				successval = -1;
+				continue;
+			}
+			arena.clear();
+			if (restoreIndexes(stage, arena, gmaindex, tplindex) == false){
+				host.message("Ran out of index memory for " + stage.path + "!");
+				successval = -1;
+				continue;
+			}
+			std::vector<bool> isrulematched;
+			std::vector<ExtractJob> jobs = selector.select(gmaindex, isrulematched);
+			if (writeExtractJobs(host, stage.path, gma, tpl, gmaindex, tplindex, jobs, threadamount, combinedsuffix) != 0){
+				successval = -1;
+			}
+			continue;
+		}
+		for (uint32_t modelnumber : matches){
+			const IndexedModel& model = stage.models[modelnumber];
+			//each texture is only listed once, however many materials use it
+			std::vector<uint16_t> texturenumbers = model.texturenumbers;
+			std::sort(texturenumbers.begin(), texturenumbers.end());
+			texturenumbers.erase(std::unique(texturenumbers.begin(), texturenumbers.end()), texturenumbers.end());
+			std::string line = stage.path + ": " + model.name + " (textures";
+			for (uint16_t texturenumber : texturenumbers){
+				line += " " + std::to_string(texturenumber);
+			}
+			host.message(line + ")");
+		}
+	}
+	host.message(std::to_string(matchamount) + " models matched in " + std::to_string(matchingstagenumbers.size()) + " of " + std::to_string(stages.size()) + " stages.");
+	return successval;
+}
+
+/*
+
+Part 5:
+Verification
+
+*/
+
+/*
+Checks the structure of a GMA and TPL pair in one pass over their headers, without building any indexes.
+Every problem found is added to problems, and it's only good if there aren't any.
+*/
+inline void verifyStage(Host& host, std::string filename, std::vector<std::string>& problems){
+	MappedFile gma;
+	MappedFile tpl;
+	if (host.openInput(gma, filename + ".gma") == false){
+		problems.push_back("GMA not found");
+		return;
+	}
+	if (host.openInput(tpl, filename + ".tpl") == false){
+		problems.push_back("TPL not found");
+		return;
+	}
+	auto hex = [](uint64_t value){
+		char hexstring[20];
+		snprintf(hexstring, sizeof(hexstring), "0x%llX", (unsigned long long)value);
+		return std::string(hexstring);
+	};
+	//TPL first, as the GMA's texture numbers are checked against it
+	TplFile tplview(tpl);
+	uint32_t textureamount = tplview.textureAmount();
+	if (tplview.length() < 0x4){
+		problems.push_back("TPL is too short to have a texture count");
+	} else if (tplview.check() == false){
+		problems.push_back("TPL has " + std::to_string(textureamount) + " textures, but only room for the headers of " + std::to_string((tplview.length() - 0x4) / 0x10));
+	} else {
+		uint64_t lasttextureoffset = tplview.entriesEnd();
+		for (uint32_t texturenumber = 0; texturenumber < textureamount; texturenumber++){
+			uint64_t textureoffset = tplview.textureStart(texturenumber);
+			if (textureoffset < lasttextureoffset){
+				problems.push_back("texture " + std::to_string(texturenumber) + " starts at " + hex(textureoffset) + ", before " + (texturenumber == 0 ? "the end of the TPL header" : "the texture before it"));
+			} else if (textureoffset > tplview.length()){
+				problems.push_back("texture " + std::to_string(texturenumber) + " starts at " + hex(textureoffset) + ", past the end of the TPL");
+			} else {
+				lasttextureoffset = textureoffset;
+			}
+		}
+	}
+	GmaFile gmaview(gma);
+	uint64_t gmalength = gmaview.length();
+	if (gmalength < 0x8){
+		problems.push_back("GMA is too short to have a header");
+		return;
+	}
+	uint32_t modelamount = gmaview.modelAmount();
+	uint64_t headerlength = gmaview.headerLength();
+	if (gmaview.nameListStart() > gmalength){
+		problems.push_back("GMA has " + std::to_string(modelamount) + " models, but only room for the offsets of " + std::to_string((gmalength - 0x8) / 0x8));
+		return;
+	}
+	if (gmaview.check() == false){
+		problems.push_back("GMA header length " + hex(headerlength) + " is outside the file or overlaps the model offsets");
+		return;
+	}
+	uint64_t lastmodelstart = headerlength;
+	for (uint32_t modelnumber = 0; modelnumber < modelamount; modelnumber++){
+		uint64_t nameoffset = gmaview.nameOffset(modelnumber);
+		if (nameoffset >= headerlength || memchr(gma.data() + nameoffset, 0, headerlength - nameoffset) == nullptr){
+			problems.push_back("model " + std::to_string(modelnumber) + "'s name isn't inside the GMA header");
+		}
+		uint64_t modelstart = gmaview.modelStart(modelnumber);
+		uint64_t modelend = gmaview.modelEnd(modelnumber);
+		if (modelstart < lastmodelstart){
+			problems.push_back("model " + std::to_string(modelnumber) + " starts at " + hex(modelstart) + ", before the model before it");
+			continue;
+		}
+		if (modelstart > gmalength || modelend > gmalength){
+			problems.push_back("model " + std::to_string(modelnumber) + " runs past the end of the GMA");
+			continue;
+		}
+		lastmodelstart = modelstart;
+		if (modelend < modelstart || modelend - modelstart < 0x40){
+			problems.push_back("model " + std::to_string(modelnumber) + " is too short for a model header");
+			continue;
+		}
+		GmaModel model = gmaview[modelnumber];
+		if (model.materialsFit() == false){
+			problems.push_back("model " + std::to_string(modelnumber) + "'s " + std::to_string(model.materialAmount()) + " materials don't fit before the next model");
+			continue;
+		}
+		uint32_t materialnumber = 0;
+		for (GmaMaterial material : model){
+			if (material.textureNumber() >= textureamount){
+				problems.push_back("model " + std::to_string(modelnumber) + " material " + std::to_string(materialnumber) + " uses texture " + std::to_string(material.textureNumber()) + ", but the TPL only has " + std::to_string(textureamount));
+			}
+			materialnumber++;
+		}
+	}
+}
+
+inline int verifyStages(Host& host, std::vector<std::string> filenames, unsigned int threadamount){
+	/*
+	Checks every stage given, and every stage in any directories given, printing what's wrong with the broken ones.
+	Stages are shared out between the threads, as each one is only a quick pass over its headers.
+	*/
+	std::vector<std::string> stages;
+	for (std::string& filename : filenames){
+		if (std::filesystem::is_directory(filename)){
+			std::vector<std::string> directorystages = findStages(filename);
+			stages.insert(stages.end(), directorystages.begin(), directorystages.end());
+		} else {
+			stages.push_back(filename);
+		}
+	}
+	const size_t maxproblemamount = 10;
+	std::atomic<int> brokenamount(0);
+	runJobs(stages.size(), threadamount, [&](size_t stagenumber){
+		std::vector<std::string> problems;
+		verifyStage(host, stages[stagenumber], problems);
+		if (problems.empty()){
+			return;
+		}
+		brokenamount++;
+		std::string lines = stages[stagenumber] + " is broken:";
+		for (size_t problemnumber = 0; problemnumber < std::min(problems.size(), maxproblemamount); problemnumber++){
+			lines += "\n  " + problems[problemnumber];
+		}
+		if (problems.size() > maxproblemamount){
+			lines += "\n  ...and " + std::to_string(problems.size() - maxproblemamount) + " more";
+		}
+		host.message(lines);
+	});
+	host.message("Checked " + std::to_string(stages.size()) + " stages, " + std::to_string(brokenamount) + " broken.");
+	return (brokenamount > 0) ? -1 : 0;
+}
+
+/*
+
+Part 6:
+Watching
+
+*/
+
+/*
+A hash of everything about a model that ends up in an extracted file: its name, its data and the textures its materials use.
+Texture numbers themselves are left out, as extracting renumbers them, so a model hashes the same in its stage and in what was extracted from it.
+*/
+inline uint64_t hashModel(const MappedFile& gma, const GmaIndex& gmaindex, const MappedFile& tpl, const TplIndex& tplindex, uint32_t modelnumber, uint64_t hash){
+	std::string_view modelname = gmaindex.modelnames[modelnumber];
+	hash = hashBytes(reinterpret_cast<const unsigned char*>(modelname.data()), modelname.length(), hash);
+	uint64_t modelstart = gmaindex.modelStart(modelnumber);
+	uint64_t modelend = gmaindex.modelEnd(modelnumber);
+	if (modelend < modelstart + 0x40 || gma.inBounds(modelstart, modelend - modelstart) == false){
+		gma.markOverrun();
+		return hash;
+	}
+	uint16_t materialamount = gma.shortPluck(modelstart+0x18);
+	uint64_t hashedto = modelstart;
+	for (uint32_t materialnumber = 0; materialnumber < materialamount; materialnumber++){
+		uint64_t texturenumberpos = modelstart + 0x44 + 0x20*materialnumber;
+		if (texturenumberpos + 0x2 > modelend){
+			break;
+		}
+		hash = hashBytes(gma.data() + hashedto, texturenumberpos - hashedto, hash);
+		hashedto = texturenumberpos + 0x2;
+		uint16_t texturenumber = gma.shortPluck(texturenumberpos);
+		uint64_t texturehash = (texturenumber < tplindex.textureamount) ? hashTexture(tpl, tplindex, texturenumber) : texturenumber;
+		hash = hashBytes(reinterpret_cast<const unsigned char*>(&texturehash), sizeof(texturehash), hash);
+	}
+	return hashBytes(gma.data() + hashedto, modelend - hashedto, hash);
+}
+
+/*
+What watch mode remembers about a stage between changes: when its GMA and TPL were last changed, and the hash of every file extracted from it.
+Unchanged stages aren't opened at all, and changed ones only have the outputs whose models changed written again.
+*/
+struct WatchedStage {
+	IndexedStage stamp;
+	std::unordered_map<std::string, uint64_t> outputhashes;
+};
+
+inline bool isOutputCurrent(Host& host, WatchedStage& watchedstage, std::string outputname, uint64_t hash){
+	if (std::filesystem::exists(outputname + ".gma") == false || std::filesystem::exists(outputname + ".tpl") == false){
+		return false;
+	}
+	auto found = watchedstage.outputhashes.find(outputname);
+	if (found == watchedstage.outputhashes.end()){
+		//nothing's been written this time round, but it could've been extracted before
+		MappedFile gma;
+		MappedFile tpl;
+		IndexArena arena;
+		GmaIndex gmaindex;
+		TplIndex tplindex;
+		if (host.openInput(gma, outputname + ".gma") == false || host.openInput(tpl, outputname + ".tpl") == false || buildGmaIndex(gma, arena, gmaindex) == false || buildTplIndex(tpl, arena, tplindex) == false){
+			return false;
+		}
+		uint64_t outputhash = 0xcbf29ce484222325;
+		for (uint32_t modelnumber = 0; modelnumber < gmaindex.modelamount; modelnumber++){
+			outputhash = hashModel(gma, gmaindex, tpl, tplindex, modelnumber, outputhash);
+		}
+		if (gma.overrun() || tpl.overrun()){
+			return false;
+		}
+		found = watchedstage.outputhashes.emplace(outputname, outputhash).first;
+	}
+	return found->second == hash;
+}
+
+inline int watchExtract(Host& host, WatchedStage& watchedstage, const ModelSelector& selector, unsigned int threadamount, std::string combinedsuffix){
+	std::string filename = watchedstage.stamp.path;
+	MappedFile gma;
+	MappedFile tpl;
+	IndexArena arena;
+	GmaIndex gmaindex;
+	TplIndex tplindex;
+	if (openModelSource(host, filename, gma, tpl, arena, gmaindex, tplindex) == false){
+		return -1;
+	}
+	std::vector<bool> isrulematched;
+	std::vector<ExtractJob> jobs = selector.select(gmaindex, isrulematched);
+	//every output's hash is worked out from the stage, and only the ones that don't match what's there already are written
+	std::vector<ExtractJob> changedjobs;
+	std::vector<std::pair<std::string, uint64_t>> changedoutputs;
+	size_t outputamount = 0;
+	if (combinedsuffix.empty() == false && jobs.empty() == false){
+		//the combined file has every model in source order, which is the order they're selected in
+		uint64_t hash = 0xcbf29ce484222325;
+		for (const ExtractJob& job : jobs){
+			hash = hashModel(gma, gmaindex, tpl, tplindex, job.modelnumber, hash);
+		}
+		outputamount = 1;
+		if (isOutputCurrent(host, watchedstage, filename + "_" + combinedsuffix, hash) == false){
+			changedjobs = jobs;
+			changedoutputs.emplace_back(filename + "_" + combinedsuffix, hash);
+		}
+	} else {
+		//skipped here, so only the job that's actually written is hashed
+		dropCollidingJobs(host, filename, jobs);
+		for (const ExtractJob& job : jobs){
+			uint64_t hash = hashModel(gma, gmaindex, tpl, tplindex, job.modelnumber, 0xcbf29ce484222325);
+			outputamount++;
+			if (isOutputCurrent(host, watchedstage, filename + "_" + job.suffix, hash) == false){
+				changedjobs.push_back(job);
+				changedoutputs.emplace_back(filename + "_" + job.suffix, hash);
+			}
+		}
+	}
+	int successval = writeExtractJobs(host, filename, gma, tpl, gmaindex, tplindex, changedjobs, threadamount, combinedsuffix);
+	for (std::pair<std::string, uint64_t>& changedoutput : changedoutputs){
+		if (successval == 0){
+			watchedstage.outputhashes[changedoutput.first] = changedoutput.second;
+		} else {
+			//whatever did get written will be hashed again next time
+			watchedstage.outputhashes.erase(changedoutput.first);
+		}
+	}
+	if (changedoutputs.size() < outputamount){
+		host.message(std::to_string(outputamount - changedoutputs.size()) + " unchanged in " + filename + ", so not saved again.");
+	}
+	return successval;
+}
+
+/*
+Waits for something in the directory to change, and then until nothing has changed for a moment, as GMAs and TPLs are usually saved one after the other.
+Uses inotify on Linux, and checks the directory every second everywhere else (or if inotify can't be used).
+*/
+const int watchquietmilliseconds = 200;
+
+inline bool waitForChange(int watchdescriptor){
+	#ifdef __linux__
+	if (watchdescriptor >= 0){
+		alignas(inotify_event) char events[0x1000];
+		pollfd watched = {watchdescriptor, POLLIN, 0};
+		int timeout = -1;
+		while (poll(&watched, 1, timeout) > 0){
+			if (read(watchdescriptor, events, sizeof(events)) < 0 && errno != EINTR){
+				return false;
+			}
+			timeout = watchquietmilliseconds;
+		}
+		return true;
+	}
+	#endif
+	std::this_thread::sleep_for(std::chrono::seconds(1));
+	return true;
+}
+
+inline int watchDirectory(Host& host, std::string directoryname, std::vector<std::string> selections, unsigned int threadamount, std::string combinedsuffix){
+	/*
+	Extracts like -be from every stage in the directory, and then again from each stage that changes, until it's stopped.
+	Stages are only opened again when their GMA or TPL has a new size or modification time, and outputs are only written again when the models in them have changed.
+	*/
+	ModelSelector selector;
+	if (buildSelector(host, selections, selector) == false){
+		return -1;
+	}
+	if (std::filesystem::is_directory(directoryname) == false){
+		host.message(directoryname + " isn't a directory!");
+		return -1;
+	}
+	int watchdescriptor = -1;
+	#ifdef __linux__
+	watchdescriptor = inotify_init1(IN_CLOEXEC);
+	if (watchdescriptor >= 0 && inotify_add_watch(watchdescriptor, directoryname.c_str(), IN_CLOSE_WRITE | IN_MOVED_TO | IN_MOVED_FROM | IN_CREATE | IN_DELETE) < 0){
+		::close(watchdescriptor);
+		watchdescriptor = -1;
+	}
+	if (watchdescriptor < 0){
+		host.message("Couldn't use inotify, so " + directoryname + " will be checked every second instead.");
+	}
+	#endif
+	std::unordered_map<std::string, WatchedStage> watchedstages;
+	host.message("Watching " + directoryname + " for changes. Press Ctrl+C to stop.");
+	do {
+		std::vector<std::string> stages = findStages(directoryname);
+		std::unordered_set<std::string> foundstages(stages.begin(), stages.end());
+		for (auto watched = watchedstages.begin(); watched != watchedstages.end();){
+			//forget anything that's been deleted or renamed
+			watched = (foundstages.count(watched->first) > 0) ? std::next(watched) : watchedstages.erase(watched);
+		}
+		std::vector<WatchedStage*> changedstages;
+		for (std::string& stage : stages){
+			IndexedStage stamp;
+			stamp.path = stage;
+			if (getStageStamp(stage, stamp.gmalength, stamp.gmatime, stamp.tpllength, stamp.tpltime) == false){
+				//it's probably mid-save, so it'll be picked up once that's finished
+				continue;
+			}
+			WatchedStage& watchedstage = watchedstages[stage];
+			const IndexedStage& oldstamp = watchedstage.stamp;
+			if (oldstamp.path == stage && oldstamp.gmalength == stamp.gmalength && oldstamp.gmatime == stamp.gmatime && oldstamp.tpllength == stamp.tpllength && oldstamp.tpltime == stamp.tpltime){
+				continue;
+			}
+			//a stage that can't be extracted isn't tried again until it changes again
+			watchedstage.stamp = stamp;
+			changedstages.push_back(&watchedstage);
+		}
+		//a single changed stage gets every thread to itself, otherwise each stage gets one
+		unsigned int stagethreadamount = (changedstages.size() == 1) ? threadamount : 1;
+		runJobs(changedstages.size(), threadamount, [&](size_t stagenumber){
+			watchExtract(host, *changedstages[stagenumber], selector, stagethreadamount, combinedsuffix);
+		});
+	} while (waitForChange(watchdescriptor));
+	host.message("Couldn't keep watching " + directoryname + "!");
+	return -1;
+}
+
+} //namespace gmatool
@@ -1,563 +1,709 @@
-#include <iostream>
-#include <fstream>
-#include <string>
-#include <cstring>
-#include <algorithm>
-#include <iterator>
-//#include <unistd.h>
-using namespace std;
-
-/*
-
-There are three parts to the goal tool:
-
-1 - Extract goals, switches, or other models
-2 - Merge any two GMAs and TPLs
-
-*/
-
-bool isLittleEndian()
-//shamelessly pinched from StackOverflow
-{
-	short int number = 0x1;
-	char *numPtr = (char*)&number;
-	return (numPtr[0] == 1);
-}
-
-uint32_t fileIntPluck (ifstream& bif, uint32_t offset){
-	bif.seekg(offset, bif.beg);
-	char buffer[4]; //4 byte buffer
-	bif.read(buffer, 0x4);
-	//convert signed to unsigned
-	unsigned char* ubuf = reinterpret_cast<unsigned char*>(buffer);
-	uint32_t returnint = 0;
-	if (isLittleEndian()){
-		returnint = (ubuf[3] << 0) | (ubuf[2] << 8) | (ubuf[1] << 16) | (ubuf[0] << 24);
-	} else {
-		returnint = (ubuf[0] << 0) | (ubuf[1] << 8) | (ubuf[2] << 16) | (ubuf[3] << 24);
-	}
-	return returnint;
-}
-
-uint16_t fileShortPluck (ifstream& bif, uint32_t offset){
-	bif.seekg(offset, bif.beg);
-	char buffer[2]; //2 byte buffer
-	bif.read(buffer, 0x2);
-	//convert signed to unsigned
-	unsigned char* ubuf = reinterpret_cast<unsigned char*>(buffer);
-	uint16_t returnshort = 0;
-	if (isLittleEndian()){
-		returnshort = (ubuf[1] << 0) | (ubuf[0] << 8);
-	} else {
-		returnshort = (ubuf[0] << 0) | (ubuf[1] << 8);
-	}
-	return returnshort;
-}
-
-int helpText(){
-	cout << "How to use gmatool:" << endl 
-		<< "Each of these saves extracted data to unique and readable gma and tpl files, and do not alter the input files." << endl
-		<< "\"-ge <name>\" - Extracts goal data from <name>.gma and <name>.tpl." << endl 
-		<< "\"-se <name>\" - Extracts switch data from <name>.gma and <name>.tpl, saving each switch to unique files, including switch bases." << endl 
-		<< "\"-me <name> <modelname>\" - Extracts the data of the model called \"modelname\" from <name>.gma and <name>.tpl." << endl
-		<< "\"-m <name1> <name2>\" - Extracts all data from <name1>.gma, <name2>.gma, <name1>.tpl and <name2>.tpl, and combines the data. The second file's data is always placed after the first." << endl;
-	return 1;
-}
-
-void copyBytes(ifstream& bif, ofstream& bof, uint64_t offset, uint64_t length){
-	char bytes[length];
-	bif.seekg(offset, bif.beg);
-	bif.read(bytes, length);
-	bof.write(bytes, length);
-}
-
-void saveIntToFileEnd(ofstream& bof, uint32_t newint){
-	char buffer[4];
-	char* initbuffer = reinterpret_cast<char*>(&newint);
-		//assigns values wrt endianness
-		if (isLittleEndian()){
-			for (int i = 0; i < 4; i++){
-				buffer[i] = initbuffer[3-i];
-			}
-		} else {
-			for (int i = 0; i < 4; i++){
-				buffer[i] = initbuffer[i];
-			}
-		}
-		//write float
-		bof.write(buffer, sizeof(uint32_t));
-}
-
-void saveShortToFileEnd(ofstream& bof, uint16_t newint){
-	char buffer[2];
-	char* initbuffer = reinterpret_cast<char*>(&newint);
-		//assigns values wrt endianness
-		if (isLittleEndian()){
-			for (int i = 0; i < 2; i++){
-				buffer[i] = initbuffer[1-i];
-			}
-		} else {
-			for (int i = 0; i < 2; i++){
-				buffer[i] = initbuffer[i];
-			}
-		}
-		//write float
-		bof.write(buffer, sizeof(uint16_t));
-}
-
-uint32_t getFileLength(ifstream& bif){
-	bif.seekg(0, bif.end);
-	uint32_t length = bif.tellg();
-	return length;
-}
-
-uint32_t getModelNameLength(ifstream& bif, uint32_t modelnameoffset, uint32_t increment){
-	uint32_t length = getFileLength(bif);
-	bif.seekg(modelnameoffset, bif.beg);
-	int modelnamelength = 0;
-	bool endofmodelname = false;
-	char endingbyte[1];
-	while (endofmodelname == false){
-		modelnamelength += increment;
-		//in case it's beyond the length of the file
-		if (modelnameoffset + modelnamelength > length){
-			modelnamelength = length - modelnameoffset;
-		}
-		bif.seekg(modelnameoffset+modelnamelength-1, bif.beg);
-		bif.read(endingbyte, 1);
-		if (endingbyte[0] == 0){
-			endofmodelname = true;
-		}
-	}
-	return modelnamelength;
-}
-
-
-void padZeroes(ofstream& bof, uint32_t zeronumber){
-	char buffer[1] = {0x0};
-	for (int i = 0; i < zeronumber; i++){
-		bof.write(buffer, 1);
-	}
-}
-
-/*
-
-Part 1:
-Goal Extraction
-
-*/
-
-void modelWriteToFiles(string filename, ifstream& oldgma, ifstream& oldtpl, int modelamount, int modelnumber, uint32_t modelnamelength, string modelname, string suffix){
-	/*
-	These files will create standalone TPL and GMA files, designed to be easily integrated into the main file.
-	*/
-	//First delete files
-	remove((filename + "_" + suffix + ".tpl").c_str());
-	remove((filename + "_" + suffix + ".gma").c_str());
-	//Write the GMA first, and we can get info for the TPL later
-	ofstream newgma(filename + "_" + suffix + ".gma", ios::binary | ios::app);
-	//Write the initial bytes
-	saveIntToFileEnd(newgma, 1); //1 model
-	//Calculate remaining length
-	/*
-	The GMA header is always a multiple of 0x20 in length. (modelnamelength + 0x10) % 0x20 gives the remaining padding
-	*/
-	uint32_t gmapadding = (-(modelnamelength+0x10)) % 0x20;
-	uint32_t newheaderlength = modelnamelength+0x10+gmapadding;
-	saveIntToFileEnd(newgma, newheaderlength);
-	//Now for the zero bytes. These point to the extra offsets, of which there isn't one
-	padZeroes(newgma, 8);
-	//Now write in the modelname
-	newgma << modelname;
-	//pad to a multiple of 0x20
-	padZeroes(newgma, gmapadding+1); //extra 1 due to missing 00 byte from modelname
-	/*
-	Now the header is written, time for the main body
-	*/
-	
-	uint64_t oldheaderlength = fileIntPluck(oldgma, 0x04);
-	uint64_t oldstartextraoffset = (fileIntPluck(oldgma, 0x08+(0x08*modelnumber)));
-	uint64_t oldstartpoint = oldheaderlength + oldstartextraoffset;
-	uint64_t oldendpoint = 0;
-	if (modelamount == modelnumber+1){
-		oldendpoint = getFileLength(oldgma);
-	} else {
-		uint64_t oldendextraoffset = fileIntPluck(oldgma, 0x10+(0x08*modelnumber));
-		oldendpoint = oldheaderlength + oldendextraoffset;
-	}
-	copyBytes(oldgma, newgma, oldstartpoint, 0x40);
-	//texture read and write, as well as copy
-	uint16_t texturearray[0xff]; //no goals will be this long but it should be a generous measurement
-	memset(texturearray, 0xff, sizeof(texturearray)); //255 initiation
-	uint16_t texturearraypointer = 0;
-	uint16_t materialamount = fileShortPluck(oldgma, oldstartpoint+0x18);
-	uint64_t oldmodelheaderlength = 0x40;
-	//Loop for each material
-	for (uint32_t materialnumber = 0; materialnumber < materialamount; materialnumber++){
-		copyBytes(oldgma, newgma, oldstartpoint+0x40+0x20*materialnumber, 0x04);
-		uint16_t materialvalue = fileShortPluck(oldgma, oldstartpoint+0x44+0x20*materialnumber);
-		uint16_t materialvaluepointer = *find(begin(texturearray), end(texturearray), materialvalue);
-		uint16_t texturearrayendpointer = *end(texturearray);
-		if (materialvaluepointer == texturearrayendpointer){
-			//Not in array - add to array
-			texturearray[texturearraypointer] = materialvalue;
-			saveShortToFileEnd(newgma, texturearraypointer); 
-			texturearraypointer += 1;
-		} else {
-			//In array - write value to array
-			uint16_t texturevalueindex = distance(texturearray, find(begin(texturearray), end(texturearray), materialvalue));
-			saveShortToFileEnd(newgma, texturevalueindex);
-		}
-		copyBytes(oldgma, newgma, oldstartpoint+0x46+0x20*materialnumber, 0x1A);
-		oldmodelheaderlength += 0x20;
-	}
-	uint64_t oldmodeldatastart = oldstartpoint + oldmodelheaderlength;
-	uint64_t oldmodeldatalength = oldendpoint - oldmodeldatastart;
-	//rest of data
-	copyBytes(oldgma, newgma, oldmodeldatastart, oldmodeldatalength);
-	newgma.close();
-	/*
-	TPL
-	*/
-	ofstream newtpl(filename + "_" + suffix + ".tpl", ios::binary | ios::app);
-	//init
-	uint32_t textureamount = texturearraypointer;
-	saveIntToFileEnd(newtpl, textureamount);
-	//header loop
-	//also creating rolling offset
-	uint32_t oldtexturestarts[textureamount];
-	uint32_t oldtextureends[textureamount];
-	uint32_t rollingoffset = 0;
-	for(int texturenumber = 0; texturenumber < textureamount; texturenumber++){
-		uint16_t oldtexturevalue = texturearray[texturenumber];
-		uint32_t oldtextureheaderpos =  oldtexturevalue*0x10+0x04;
-		oldtexturestarts[texturenumber] = fileIntPluck(oldtpl, oldtextureheaderpos+0x04);
-		if (oldtexturevalue < fileIntPluck(oldtpl, 0x0) - 1){
-			//if it's less than this then the texture ends at the next value
-			oldtextureends[texturenumber] = fileIntPluck(oldtpl, oldtextureheaderpos+0x14);
-		} else {
-			//else it ends at the end of the file
-			oldtextureends[texturenumber] = getFileLength(oldtpl);
-		}
-		//copy initial bytes 
-		copyBytes(oldtpl, newtpl, oldtextureheaderpos, 0x4);
-		if (texturenumber == 0){
-			//the first offset will always be the length of the header
-			rollingoffset = (textureamount*0x10 + 0x10);
-		} else {
-			//the offset is based on the length of the previous one
-			rollingoffset += (oldtextureends[texturenumber-1] - oldtexturestarts[texturenumber-1]);
-		}
-		saveIntToFileEnd(newtpl, rollingoffset);
-		copyBytes(oldtpl, newtpl,  oldtextureheaderpos+0x08, 0x08);
-	}
-	//padding
-	int tplpaddingamount = (- 0x04 + (0x10*textureamount)) % 0x20;
-	for (uint8_t tplpaddingpointer = 0x0; tplpaddingpointer < tplpaddingamount; tplpaddingpointer++){
-		newtpl << tplpaddingpointer;
-	}
-	//texture loop
-	for(int texturenumber = 0; texturenumber < textureamount; texturenumber++){
-		copyBytes(oldtpl, newtpl,  oldtexturestarts[texturenumber], oldtextureends[texturenumber]-oldtexturestarts[texturenumber]);
-	}
-	newtpl.close();
-	std::cout << "saved to " << filename << "_" << suffix << endl;
-}
-
-int modelExtract(string filename, int type, string specificmodel){
-	ifstream gma;
-	ifstream tpl;
-	//open files and check that they're good
-	//
-	gma.open(filename + ".gma", ios::binary);
-	if (gma.good() == false) {
-		cout << "No GMA found!" << endl;
-		return -1;
-	}
-	tpl.open(filename + ".tpl", ios::binary);
-	if (tpl.good() == false) {
-		cout << "No TPL found!" << endl;
-		return -1;
-	}
-	//If the files are good we can read the gma for the files
-	uint32_t modelamount = fileIntPluck(gma, 0);
-	uint32_t modellistoffset = modelamount * 0x8 + 0x8; //Start of model list - 0x8 initial bytes plus 0x8 for each model
-	uint32_t modellistpointer = modellistoffset;
-	uint32_t modelnamelength = 0;
-	string modelname = "";
-	if (type == 1){
-		//Goal extraction block
-		bool hasBlueGoal = false;
-		bool hasGreenGoal = false;
-		bool hasRedGoal = false;
-		for (int modelnumber = 0; modelnumber < modelamount; modelnumber++){
-			modelnamelength = getModelNameLength(gma, modellistpointer, 1);
-			char bytes[modelnamelength];
-			gma.seekg(modellistpointer, gma.beg);
-			gma.read(bytes, modelnamelength);
-			string modelname(bytes);
-			if (hasBlueGoal == false){
-				if (modelname.substr(3,5) == "_GOAL"){
-					std::cout << modelname << " (Blue goal) ";
-					modelWriteToFiles(filename, gma, tpl, modelamount, modelnumber, modelnamelength, modelname, "GOAL_B");
-					hasBlueGoal = true;
-				}
-			} else if (hasGreenGoal == false){
-				if (modelname.substr(3,7) == "_GOAL_G"){
-					std::cout << modelname << " (Green goal) ";
-					modelWriteToFiles(filename, gma, tpl, modelamount, modelnumber, modelnamelength, modelname, "GOAL_G");
-					hasGreenGoal = true;
-				}
-			} else if (hasRedGoal == false){
-				if (modelname.substr(3,7) == "_GOAL_R"){
-					std::cout << modelname << " (Red goal) ";
-					modelWriteToFiles(filename, gma, tpl, modelamount, modelnumber, modelnamelength, modelname, "GOAL_R");
-					hasRedGoal = true;
-				}
-			}
-			modellistpointer += (modelnamelength);
-		}
-		if (hasBlueGoal == false){
-			cout << "No blue goal found!";
-		}
-	} else if (type == 2){
-		//Switch extraction block
-		bool hasSwitches = false;
-		for (int modelnumber = 0; modelnumber < modelamount; modelnumber++){
-			modelnamelength = getModelNameLength(gma, modellistpointer, 1);
-			char bytes[modelnamelength];
-			gma.seekg(modellistpointer, gma.beg);
-			gma.read(bytes, modelnamelength);
-			string modelname(bytes);
-			if (modelname.substr(0,7) == "BUTTON_"){
-				std::cout << modelname << " ";
-				modelWriteToFiles(filename, gma, tpl, modelamount, modelnumber, modelnamelength, modelname, modelname);
-				hasSwitches = true;
-			}
-			modellistpointer += (modelnamelength);
-		}
-		if (hasSwitches == false){
-			cout << "No switches found!";
-		}
-	} else if (type == 3){
-		//Specific model extraction block
-		bool hasSpecificModel = false;
-		for (int modelnumber = 0; modelnumber < modelamount; modelnumber++){
-			modelnamelength = getModelNameLength(gma, modellistpointer, 1);
-			char bytes[modelnamelength];
-			gma.seekg(modellistpointer, gma.beg);
-			gma.read(bytes, modelnamelength);
-			string modelname(bytes);
-			if (modelname == specificmodel){
-				std::cout << modelname << " ";
-				modelWriteToFiles(filename, gma, tpl, modelamount, modelnumber, modelnamelength, modelname, modelname);
-				hasSpecificModel = true;
-			}
-			modellistpointer += (modelnamelength);
-		}
-		if (hasSpecificModel == false){
-			cout << "The model " << specificmodel << " wasn't found!";
-		}
-	}
-	gma.close();
-	tpl.close();
-	return 0;
-}
-
-
-/*
-
-Part 2:
-Model Merge
-
-*/
-
-int gmatplMerge(string filename1, string filename2){
-	ifstream gma1;
-	ifstream gma2;
-	ifstream tpl1;
-	ifstream tpl2;
-	gma1.open(filename1 + ".gma", ios::binary);
-	if (gma1.good() == false) {
-		cout << "First GMA not found! (" << filename1 << ".gma)" << endl;
-		return -1;
-	}
-	gma2.open(filename2 + ".gma", ios::binary);
-	if (gma2.good() == false) {
-		cout << "Second GMA not found! (" << filename2 << ".gma)" << endl;
-		return -1;
-	}
-	tpl1.open(filename1 + ".tpl", ios::binary);
-	if (tpl1.good() == false) {
-		cout << "First TPL not found! (" << filename1 << ".tpl)" << endl;
-		return -1;
-	}
-	tpl2.open(filename2 + ".tpl", ios::binary);
-	if (tpl2.good() == false) {
-		cout << "Second TPL not found! (" << filename2 << ".tpl)" << endl;
-		return -1;
-	}
-	cout << "Merging GMAs and TPLs " << filename1 << " and " << filename2 << "..." << endl;
-	//Remove old files
-	remove((filename1 + "+" + filename2 + ".tpl").c_str());
-	remove((filename1 + "+" + filename2 + ".gma").c_str());
-	//First the GMA.
-	//append number of models
-	ofstream newgma(filename1 + "+" + filename2 + ".gma", ios::binary | ios::app);
-	uint32_t gma1modelamount = fileIntPluck(gma1, 0x0);
-	uint32_t gma2modelamount = fileIntPluck(gma2, 0x0);
-	uint32_t newgmamodelamount = gma1modelamount + gma2modelamount;
-	saveIntToFileEnd(newgma, newgmamodelamount);
-	//Calculate length and start positions of gma1 and gma2 modellists
-	uint32_t gma1nameliststart = 0x08*gma1modelamount + 0x08;
-	uint32_t gma1lastnamestart = fileIntPluck(gma1, 0x08*gma1modelamount + 0x04) + gma1nameliststart;
-	uint32_t gma1namelistend = getModelNameLength(gma1, gma1lastnamestart, 1) + gma1lastnamestart;
-	uint32_t gma1namelistlength = gma1namelistend - gma1nameliststart;
-	uint32_t gma2nameliststart = 0x08*gma2modelamount + 0x08;
-	uint32_t gma2lastnamestart = fileIntPluck(gma2, 0x08*gma2modelamount + 0x04) + gma2nameliststart;
-	uint32_t gma2namelistend = getModelNameLength(gma2, gma2lastnamestart, 1) + gma2lastnamestart + 1;
-	uint32_t gma2namelistlength = gma2namelistend - gma2nameliststart;
-	//With these we can create the new length of the GMA header
-	//The pure header length is the initial bytes, plus the 8 times the number of of models, plus the sum of the lengths of the model name lists
-	uint32_t newgmapureheaderlength = 0x8 + (newgmamodelamount)*0x8 + gma1namelistlength + gma2namelistlength;
-	uint32_t newgmaheaderpadding = (-newgmapureheaderlength) % 0x20; //to pad it to 20
-	uint32_t newgmaheaderlength = newgmapureheaderlength + newgmaheaderpadding;
-	saveIntToFileEnd(newgma, newgmaheaderlength);
-	//Here let's get the header and total lengths
-	uint32_t gma1filelength = getFileLength(gma1);
-	uint32_t gma1headerlength = fileIntPluck(gma1, 0x04);
-	uint32_t gma1datalength = gma1filelength - gma1headerlength;
-	uint32_t gma2filelength = getFileLength(gma2);
-	uint32_t gma2headerlength = fileIntPluck(gma2, 0x04);
-	uint32_t gma2datalength = gma2filelength - gma2headerlength;
-	//The GMA1 bytes need no shifts as it comes first
-	copyBytes(gma1, newgma, 0x8, gma1nameliststart-0x8);
-	//The GMA2 bytes need an increase in both name list offset and data offset
-	for (uint32_t gma2modelnumber = 0; gma2modelnumber < gma2modelamount; gma2modelnumber++){
-		uint32_t gma2modeldataoffset = fileIntPluck(gma2, 0x8+0x8*gma2modelnumber);
-		saveIntToFileEnd(newgma, gma2modeldataoffset + gma1datalength);
-		uint32_t gma2modelnameoffset = fileIntPluck(gma2, 0xC+0x8*gma2modelnumber);
-		saveIntToFileEnd(newgma, gma2modelnameoffset + gma1namelistlength);
-	}
-	//Model name lists
-	copyBytes(gma1, newgma, gma1nameliststart, gma1namelistlength);
-	copyBytes(gma2, newgma, gma2nameliststart, gma2namelistlength);
-	//Padding
-	padZeroes(newgma, newgmaheaderpadding);
-	//GMA1 Model data. Can all be copied over.
-	copyBytes(gma1, newgma, gma1headerlength, gma1datalength);
-	//GMA2 Model data needs all of its textures shifted up
-	//get number of textures from TPL1 and TPL2
-	uint32_t tpl1textureamount = fileIntPluck(tpl1, 0x0);
-	uint32_t tpl2textureamount = fileIntPluck(tpl2, 0x0);
-	//loop for each header
-	for (uint32_t gma2modelnumber = 0; gma2modelnumber < gma2modelamount; gma2modelnumber++){
-		//i'm so lazy lol
-		uint64_t oldstartextraoffset = (fileIntPluck(gma2, 0x08+(0x08*gma2modelnumber)));
-		uint64_t oldstartpoint = gma2headerlength + oldstartextraoffset; //start of the model data
-		uint64_t oldendpoint = 0;
-		if (gma2modelamount == gma2modelnumber+1){ 
-			oldendpoint = getFileLength(gma2);
-		} else {
-			uint64_t oldendextraoffset = fileIntPluck(gma2, 0x10+(0x08*gma2modelnumber));
-			oldendpoint = gma2headerlength + oldendextraoffset;
-		}
-		uint16_t materialamount = fileShortPluck(gma2, oldstartpoint+0x18);
-		copyBytes(gma2, newgma, oldstartpoint, 0x40);
-		uint64_t oldmodelheaderlength = 0x40;
-		//Loop for each material
-		for (uint32_t materialnumber = 0; materialnumber < materialamount; materialnumber++) {
-			copyBytes(gma2, newgma, oldstartpoint+0x40+0x20*materialnumber, 0x04);
-			uint16_t materialvalue = fileShortPluck(gma2, oldstartpoint+0x44+0x20*materialnumber);
-			saveShortToFileEnd(newgma, materialvalue + tpl1textureamount);
-			copyBytes(gma2, newgma, oldstartpoint+0x46+0x20*materialnumber, 0x1A);
-			oldmodelheaderlength += 0x20;
-		}
-		uint64_t oldmodeldatastart = oldstartpoint + oldmodelheaderlength;
-		uint64_t oldmodeldatalength = oldendpoint - oldmodeldatastart;
-		//rest of data
-		copyBytes(gma2, newgma, oldmodeldatastart, oldmodeldatalength);
-	}
-	//we're done here
-	newgma.close();
-	//Now for the TPL
-	ofstream newtpl(filename1 + "+" + filename2 + ".tpl", ios::binary | ios::app);
-	//we can write the first byte straight away
-	uint32_t newtpltextureamount = tpl1textureamount+tpl2textureamount;
-	saveIntToFileEnd(newtpl, newtpltextureamount);
-	//Now to work out the file header length 
-	int newtplpaddingamount = (- 0x04 + (0x10*newtpltextureamount)) % 0x20;
-	uint32_t newtplheaderlength = 0x04 + (0x10*newtpltextureamount) + newtplpaddingamount;
-	uint32_t tpl1headerlength = fileIntPluck(tpl1, 0x08);
-	uint32_t tpl2headerlength = fileIntPluck(tpl2, 0x08);
-	uint32_t tpl1length = getFileLength(tpl1);
-	uint32_t tpl2length = getFileLength(tpl2);
-	for (uint32_t newtpltexturenumber = 0; newtpltexturenumber < newtpltextureamount; newtpltexturenumber++){
-		if (newtpltexturenumber < tpl1textureamount){
-			//take from tpl1
-			copyBytes(tpl1, newtpl, newtpltexturenumber*0x10+0x04, 0x04);
-			uint32_t oldtpl1textureoffset = fileIntPluck(tpl1, (newtpltexturenumber*0x10) + 0x08);
-			saveIntToFileEnd(newtpl, oldtpl1textureoffset - tpl1headerlength + newtplheaderlength);
-			copyBytes(tpl1, newtpl, (newtpltexturenumber*0x10) + 0x0C, 0x08);
-		} else { //newtpltexturenumber >= tpl1textureamount
-			//take from tpl2
-			copyBytes(tpl2, newtpl, (newtpltexturenumber-tpl1textureamount)*0x10+0x04, 0x04);
-			uint32_t oldtpl2textureoffset = fileIntPluck(tpl2, ((newtpltexturenumber-tpl1textureamount)*0x10) + 0x08);
-			saveIntToFileEnd(newtpl, oldtpl2textureoffset - tpl2headerlength + tpl1length - tpl1headerlength + newtplheaderlength); //AAAAAA
-			copyBytes(tpl2, newtpl, ((newtpltexturenumber-tpl1textureamount)*0x10)+0x0C, 0x08);
-		}
-	}
-	for (uint8_t tplpaddingpointer = 0x0; tplpaddingpointer < newtplpaddingamount; tplpaddingpointer++){
-		newtpl << tplpaddingpointer;
-	}
-	//remaining data bytes, tpl1
-	if (tpl1textureamount != 0){
-		copyBytes(tpl1, newtpl, tpl1headerlength, tpl1length - tpl1headerlength);
-	}
-	//tpl2
-	if (tpl2textureamount != 0){
-		copyBytes(tpl2, newtpl, tpl2headerlength, tpl2length - tpl2headerlength);
-	}
-	newtpl.close();
-	gma1.close();
-	tpl1.close();
-	gma2.close();
-	tpl2.close();
-	return 0;
-}
-
-/*
-
-Main body
-
-*/
-
-int main(int argc, char* argv[]){
-	int successval = 1;
-	if (argc >= 3) {
-		string operationtype(argv[1]);
-		if (argc == 3) {
-			if (operationtype == "-ge") {
-				string filename(argv[2]);
-				successval = modelExtract(filename, 1, "");
-			} else if (operationtype == "-se"){
-				string filename(argv[2]);
-				successval = modelExtract(filename, 2, "");
-			}
-		} else if (argc == 4) {
-			if (operationtype == "-me") {
-				string filename(argv[2]);
-				string specificmodelname(argv[3]);
-				successval = modelExtract(filename, 3, specificmodelname);
-			} else if (operationtype == "-m") {
-				string filename1(argv[2]);
-				string filename2(argv[3]);
-				successval = gmatplMerge(filename1, filename2);
-			} else {successval = helpText();}
-		} else {successval = helpText();}
-	} else {successval = helpText();}
-	if (successval == 0){
-		cout << endl << "Done!";
-	}
-	return successval;
-}
\ No newline at end of file
+#include "gmatool.h"
+using namespace std;
+using namespace gmatool;
+
+/*
+
+There are three parts to the goal tool:
+
+1 - Extract goals, switches, or other models
+2 - Merge any number of GMAs and TPLs
+
+*/
+
+int helpText(){
+	cout << "How to use gmatool:" << endl 
+		<< "Each of these saves extracted data to unique and readable gma and tpl files, and do not alter the input files." << endl
+		<< "\"-ge <name>\" - Extracts goal data from <name>.gma and <name>.tpl." << endl 
+		<< "\"-se <name>\" - Extracts switch data from <name>.gma and <name>.tpl, saving each switch to unique files, including switch bases." << endl 
+		<< "\"-me <name> <modelname>\" - Extracts the data of the model called \"modelname\" from <name>.gma and <name>.tpl." << endl
+		<< "\"-be <name> <modelname>...\" - Extracts every listed model from <name>.gma and <name>.tpl in one go. Model names can use * and ? as wildcards, \"re:<regex>\" matches a regular expression, \":goals\" and \":switches\" pick the same models as -ge and -se, and \"@<file>\" reads a list of model names from <file>, one per line. Adding \"=<suffix>\" saves the first match to <name>_<suffix> instead of using its model name, so goals, switches and anything else can all be extracted in one go." << endl
+		<< "\"-shard <name> <count>\" - Splits <name>.gma and <name>.tpl into <count> packs, <name>_shard1 and so on, each with about the same amount of model and texture data and only the textures its models use." << endl
+		<< "\"-shard <name> <modelnames> <modelnames>...\" - The same, but with one pack for each list of model names, separated by commas, which can use anything -be can. Models go to the first list they match." << endl
+		<< "\"-dge <directory>\" and \"-dse <directory>\" - Extracts goal or switch data from every stage in <directory>." << endl
+		<< "\"-m <name1> <name2>...\" - Extracts all data from <name1>.gma, <name2>.gma, <name1>.tpl, <name2>.tpl and so on, and combines the data into <name1>+<name2>+... Each file's data is always placed after the ones before it." << endl
+		<< "\"-mo <output> <name1> <name2>...\" - The same as -m, but saves the combined data to <output>.gma and <output>.tpl." << endl
+		<< "\"-a <target> <name1> <name2>...\" - Adds the models and textures from <name1>.gma, <name1>.tpl and so on onto the end of <target>.gma and <target>.tpl, changing them in place. Only the headers are rewritten, so this is much quicker than -m on big files. Keep a copy of the target if it matters, as an interrupted append can leave it broken." << endl
+		<< "\"-index <index> <name or directory>...\" - Adds stages to the asset index file <index>, keeping what's known about every model so they can be searched without opening each stage again. Stages that haven't changed since they were last indexed are skipped." << endl
+		<< "\"-query <index> <modelname>...\" - Lists every model in the asset index matching any of the model names, which can use * and ? as wildcards, along with the textures it uses." << endl
+		<< "\"-qe <index> <modelname>...\" - The same as -query, but extracts every match from its stage, like -be." << endl
+		<< "\"-w <directory> <modelname>...\" - Extracts every listed model, like -be, from every stage in <directory>, and then keeps watching it, extracting again from any stage that's saved. Only files whose models have actually changed are written again, so \"-w <directory> :goals :switches\" keeps every stage's goals and switches up to date. Stop it with Ctrl+C." << endl
+		<< "\"-v <name or directory>...\" - Checks that each GMA and TPL pair is structurally sound (offsets in order and inside the files, materials fitting inside their models, texture numbers in the TPL and so on), and lists what's wrong with any that aren't." << endl
+		<< "\"-bench <directory> [<setting>=<value>]...\" - Generates synthetic stages in <directory> and times every extract and merge mode on them, printing the results as JSON. The settings are models, namelength, materials, textures, texturesize, modelsize (both in bytes) and runs. With textures=0, models have no materials." << endl
+		<< "Options, which go before everything else:" << endl
+		<< "\"-j <threads>\" - Extracts models (or whole stages, in directory mode) on several threads at once. \"-j 0\" uses one thread per core." << endl
+		<< "\"-o -\" or \"-o fd:<number>\" - Pipeline mode: sends every saved GMA and TPL to stdout (or that file descriptor) as an archive instead of saving them. Any <name> can also be \"-\" or \"fd:<number>\" to read an archive from stdin (or that file descriptor), which works on every GMA and TPL pair in it, so extracts and merges can be chained without any files in between." << endl
+		<< "\"--stats\" or \"--stats=json\" - Once finished, prints how long was spent building indexes, writing headers, remapping materials, copying data and rebuilding TPLs, along with how many files were opened and how many reads, writes, kernel copies and seeks were made and how many bytes they moved." << endl
+		<< "\"-c <suffix>\" - Extracts every model picked by an extraction into one combined <name>_<suffix>.gma and .tpl, with a single copy of each texture they use, instead of a pair for each model." << endl
+		<< "\"-dedup\" - When merging, only keeps one copy of identical textures and points every material that used them at it." << endl;
+	return 1;
+}
+
+
+/*
+
+Pipeline mode
+
+*/
+
+/*
+Reads or writes everything in one go on a raw file descriptor, which could be a pipe.
+Reads and writes on pipes can come back short, so they keep going until it's all done.
+*/
+bool readWhole(int descriptor, vector<unsigned char>& bytes){
+	bytes.clear();
+	unsigned char chunk[0x10000];
+	while (true){
+		#ifdef _WIN32
+		int readlength = _read(descriptor, chunk, sizeof(chunk));
+		#else
+		ssize_t readlength = ::read(descriptor, chunk, sizeof(chunk));
+		if (readlength < 0 && errno == EINTR){
+			continue;
+		}
+		#endif
+		if (readlength < 0){
+			return false;
+		}
+		if (readlength == 0){
+			return true;
+		}
+		runstats.reads++;
+		runstats.bytesread += readlength;
+		bytes.insert(bytes.end(), chunk, chunk + readlength);
+	}
+}
+
+bool writeWhole(int descriptor, const unsigned char* bytes, uint64_t length){
+	while (length > 0){
+		#ifdef _WIN32
+		int writelength = _write(descriptor, bytes, unsigned(min<uint64_t>(length, 0x40000000)));
+		#else
+		ssize_t writelength = ::write(descriptor, bytes, min<uint64_t>(length, 0x40000000));
+		if (writelength < 0 && errno == EINTR){
+			continue;
+		}
+		#endif
+		if (writelength <= 0){
+			return false;
+		}
+		runstats.writes++;
+		runstats.byteswritten += writelength;
+		bytes += writelength;
+		length -= writelength;
+	}
+	return true;
+}
+
+/*
+In pipeline mode, inputs and outputs go through stdin, stdout or other file descriptors instead of named files.
+They're sent as a simple archive: one frame for each file, with a 4 byte name length, the name, an 8 byte data length and then the data.
+A GMA and TPL pair are two frames with the same name apart from the extension.
+Inputs are read into memory up front, and anything opened by that name afterwards reads from there instead of the disk.
+Outputs are built in memory and written as a single frame once they're finished, so frames from different threads never mix.
+This is the only place whole files are held in memory. Everywhere else, data is copied straight from the mapped inputs, so very big packs are better off going through files.
+*/
+class PipelineArchive {
+	public:
+	bool readFrom(int descriptor, vector<string>& stems);
+	void writeTo(int descriptor){
+		outputdescriptor = descriptor;
+	}
+	bool isWriting() const {
+		return outputdescriptor >= 0;
+	}
+	bool writeFrame(const string& name, const unsigned char* bytes, uint64_t length);
+	const vector<unsigned char>* find(const string& name) const {
+		auto fileposition = files.find(name);
+		return (fileposition != files.end()) ? &fileposition->second : nullptr;
+	}
+	private:
+	unordered_map<string, vector<unsigned char>> files;
+	int outputdescriptor = -1;
+	mutex outputmutex;
+};
+
+PipelineArchive pipelinearchive;
+
+/*
+"-" is stdin or stdout, depending on which way it's going, and "fd:<number>" is any other open file descriptor.
+Anything else is a normal file name, so this gives -1.
+*/
+int parseDescriptor(string name, int standarddescriptor){
+	if (name == "-"){
+		return standarddescriptor;
+	}
+	if (name.size() > 3 && name.compare(0, 3, "fd:") == 0 && all_of(name.begin()+3, name.end(), ::isdigit)){
+		return atoi(name.c_str()+3);
+	}
+	return -1;
+}
+
+bool PipelineArchive::readFrom(int descriptor, vector<string>& stems){
+	#ifdef _WIN32
+	_setmode(descriptor, _O_BINARY);
+	#endif
+	vector<unsigned char> bytes;
+	if (readWhole(descriptor, bytes) == false){
+		return false;
+	}
+	auto readNumber = [&](uint64_t& position, int length){
+		uint64_t value = 0;
+		for (int bytenumber = 0; bytenumber < length; bytenumber++){
+			value = (value << 8) | bytes[position+bytenumber];
+		}
+		position += length;
+		return value;
+	};
+	uint64_t position = 0;
+	while (position < bytes.size()){
+		if (bytes.size() - position < 0x4){
+			return false;
+		}
+		uint64_t namelength = readNumber(position, 0x4);
+		if (bytes.size() - position < namelength + 0x8){
+			return false;
+		}
+		string name(reinterpret_cast<const char*>(bytes.data()) + position, namelength);
+		position += namelength;
+		uint64_t datalength = readNumber(position, 0x8);
+		if (bytes.size() - position < datalength){
+			return false;
+		}
+		files[name].assign(bytes.begin() + position, bytes.begin() + position + datalength);
+		position += datalength;
+		//each pair is one input, named without its extension
+		string stem = name.substr(0, name.find_last_of('.'));
+		if (std::find(stems.begin(), stems.end(), stem) == stems.end()){
+			stems.push_back(stem);
+		}
+	}
+	return true;
+}
+
+bool PipelineArchive::writeFrame(const string& name, const unsigned char* bytes, uint64_t length){
+	unsigned char frameheader[0xC];
+	uint64_t namelength = name.size();
+	for (int bytenumber = 0; bytenumber < 0x4; bytenumber++){
+		frameheader[bytenumber] = uint8_t(namelength >> (8*(3-bytenumber)));
+	}
+	for (int bytenumber = 0; bytenumber < 0x8; bytenumber++){
+		frameheader[0x4+bytenumber] = uint8_t(length >> (8*(7-bytenumber)));
+	}
+	lock_guard<mutex> outputlock(outputmutex);
+	return writeWhole(outputdescriptor, frameheader, 0x4)
+		&& writeWhole(outputdescriptor, reinterpret_cast<const unsigned char*>(name.data()), namelength)
+		&& writeWhole(outputdescriptor, frameheader+0x4, 0x8)
+		&& writeWhole(outputdescriptor, bytes, length);
+}
+
+/*
+Messages go to the console a whole line at a time, since they can come from several threads at once.
+In pipeline mode, anything in the input archive is read from there instead of the disk, and every output is built in memory and sent on as one archive frame once it's closed.
+*/
+class ConsoleHost : public Host {
+	public:
+	bool openInput(MappedFile& file, string filename) override {
+		const vector<unsigned char>* archivedfile = pipelinearchive.find(filename);
+		if (archivedfile != nullptr){
+			return file.openBuffer(archivedfile->data(), archivedfile->size());
+		}
+		return file.open(filename);
+	}
+	bool openOutput(OutputBuilder& file, string filename) override {
+		if (pipelinearchive.isWriting() == false){
+			return file.open(filename);
+		}
+		shared_ptr<vector<unsigned char>> bytes = make_shared<vector<unsigned char>>();
+		return file.openBuffer(*bytes, [bytes, filename](){
+			return pipelinearchive.writeFrame(filename, bytes->data(), bytes->size());
+		});
+	}
+	void message(string line) override {
+		lock_guard<mutex> consolelock(consolemutex);
+		cout << line << endl;
+	}
+	private:
+	mutex consolemutex;
+};
+
+/*
+Everything being benchmarked prints as it goes, which would only get in the way of the results.
+*/
+class QuietHost : public Host {
+	public:
+	void message(string) override {}
+};
+
+/*
+
+Part 3:
+Benchmarks
+
+*/
+
+/*
+The shape of a synthetic stage. Lengths are in bytes and get rounded up to a multiple of 0x20, like real model and texture data.
+*/
+struct SyntheticStageSettings {
+	uint32_t modelamount = 1000;
+	uint32_t namelength = 12;
+	uint32_t materialamount = 4;
+	uint32_t textureamount = 256;
+	uint32_t texturelength = 0x2000;
+	uint32_t modellength = 0x1000;
+};
+
+bool writeSyntheticStage(string filename, const SyntheticStageSettings& settings, uint64_t seed){
+	/*
+	The first three models are goals and every tenth one after that is a switch, so every extraction mode has something to find.
+	Everything that isn't a count, offset or texture number is random, and the same seed always makes the same stage.
+	*/
+	uint32_t modellength = settings.modellength + ((-settings.modellength) % 0x20);
+	uint32_t texturelength = max(0x20u, settings.texturelength + ((-settings.texturelength) % 0x20));
+	vector<unsigned char> randombytes(max(modellength, texturelength) + 0x40 + 0x20*settings.materialamount);
+	for (unsigned char& randombyte : randombytes){
+		//xorshift
+		seed ^= seed << 13;
+		seed ^= seed >> 7;
+		seed ^= seed << 17;
+		randombyte = uint8_t(seed);
+	}
+	vector<string> modelnames(settings.modelamount);
+	uint64_t namelistlength = 0;
+	for (uint32_t modelnumber = 0; modelnumber < settings.modelamount; modelnumber++){
+		string modelname;
+		if (modelnumber < 3){
+			modelname = string("ST1_GOAL") + (modelnumber == 1 ? "_G" : (modelnumber == 2 ? "_R" : ""));
+		} else if (modelnumber % 10 == 3){
+			modelname = "BUTTON_" + to_string(modelnumber);
+		} else {
+			modelname = "MODEL_" + to_string(modelnumber);
+		}
+		if (modelname.length() < settings.namelength){
+			modelname.append(settings.namelength - modelname.length(), 'X');
+		}
+		modelnames[modelnumber] = modelname;
+		namelistlength += modelname.length() + 1;
+	}
+	OutputBuilder newgma;
+	if (newgma.open(filename + ".gma") == false){
+		return false;
+	}
+	uint64_t modeltotallength = 0x40 + 0x20*settings.materialamount + modellength;
+	uint64_t gmapureheaderlength = 0x08 + 0x08*uint64_t(settings.modelamount) + namelistlength;
+	newgma.putInt(settings.modelamount);
+	newgma.putInt(gmapureheaderlength + ((-gmapureheaderlength) % 0x20));
+	uint64_t nameoffset = 0;
+	for (uint32_t modelnumber = 0; modelnumber < settings.modelamount; modelnumber++){
+		newgma.putInt(modelnumber * modeltotallength);
+		newgma.putInt(nameoffset);
+		nameoffset += modelnames[modelnumber].length() + 1;
+	}
+	for (string& modelname : modelnames){
+		newgma.putBytes(modelname.c_str(), modelname.length() + 1);
+	}
+	newgma.putZeroes((-gmapureheaderlength) % 0x20);
+	for (uint32_t modelnumber = 0; modelnumber < settings.modelamount; modelnumber++){
+		//each model takes its random bytes from a different place, so no two are the same
+		const unsigned char* modelbytes = randombytes.data() + (modelnumber % 0x20);
+		newgma.putBytes(modelbytes, 0x18);
+		newgma.putShort(settings.materialamount);
+		newgma.putBytes(modelbytes + 0x1A, 0x26);
+		for (uint32_t materialnumber = 0; materialnumber < settings.materialamount; materialnumber++){
+			const unsigned char* materialbytes = modelbytes + 0x40 + 0x20*materialnumber;
+			newgma.putBytes(materialbytes, 0x04);
+			newgma.putShort((modelnumber * 7 + materialnumber * 13) % settings.textureamount);
+			newgma.putBytes(materialbytes + 0x06, 0x1A);
+		}
+		newgma.putBytes(randombytes.data() + (modelnumber % 0x20), modellength);
+	}
+	if (newgma.close() == false){
+		return false;
+	}
+	OutputBuilder newtpl;
+	if (newtpl.open(filename + ".tpl") == false){
+		return false;
+	}
+	uint32_t tplheaderlength = tplHeaderLength(settings.textureamount);
+	newtpl.putInt(settings.textureamount);
+	for (uint32_t texturenumber = 0; texturenumber < settings.textureamount; texturenumber++){
+		newtpl.putInt(randombytes[texturenumber % randombytes.size()] % 0x0F); //format
+		newtpl.putInt(tplheaderlength + uint64_t(texturenumber) * texturelength);
+		newtpl.putShort(0x40);
+		newtpl.putShort(0x40);
+		newtpl.putShort(0x01);
+		newtpl.putShort(0x1234);
+	}
+	newtpl.putZeroes(tplheaderlength - newtpl.size());
+	for (uint32_t texturenumber = 0; texturenumber < settings.textureamount; texturenumber++){
+		//the texture number goes at the start so every texture is different
+		newtpl.putInt(texturenumber);
+		newtpl.putBytes(randombytes.data() + (texturenumber % 0x20), texturelength - 0x04);
+	}
+	return newtpl.close();
+}
+
+struct BenchmarkResult {
+	string name;
+	double seconds;
+	uint64_t modelamount;
+	uint64_t outputlength;
+};
+
+uint64_t removeOutputs(string directoryname, string prefix, uint64_t& modelamount){
+	//returns how much was removed, which is how much the benchmark wrote, and counts the models in every GMA removed
+	uint64_t removedlength = 0;
+	modelamount = 0;
+	error_code directoryerror;
+	vector<filesystem::path> outputpaths;
+	for (const filesystem::directory_entry& entry : filesystem::directory_iterator(directoryname, directoryerror)){
+		if (entry.path().filename().string().compare(0, prefix.length(), prefix) == 0){
+			outputpaths.push_back(entry.path());
+		}
+	}
+	for (filesystem::path& outputpath : outputpaths){
+		if (outputpath.extension() == ".gma"){
+			MappedFile gma;
+			if (gma.open(outputpath.string())){
+				modelamount += gma.intPluck(0x0);
+			}
+		}
+		removedlength += filesystem::file_size(outputpath, directoryerror);
+		filesystem::remove(outputpath, directoryerror);
+	}
+	return removedlength;
+}
+
+bool runBenchmark(vector<BenchmarkResult>& results, string name, string directoryname, string outputprefix, uint32_t runamount, const function<int()>& operation){
+	//the fastest run is the one least disturbed by everything else on the machine
+	//models are counted from what was actually written, so a mode that quietly writes fewer shows up in the results
+	BenchmarkResult result = {name, 0.0, 0, 0};
+	uint64_t oldmodelamount;
+	for (uint32_t runnumber = 0; runnumber < runamount; runnumber++){
+		removeOutputs(directoryname, outputprefix, oldmodelamount);
+		chrono::steady_clock::time_point starttime = chrono::steady_clock::now();
+		int successval = operation();
+		double seconds = chrono::duration<double>(chrono::steady_clock::now() - starttime).count();
+		if (successval != 0){
+			return false;
+		}
+		if (runnumber == 0 || seconds < result.seconds){
+			result.seconds = seconds;
+		}
+	}
+	result.outputlength = removeOutputs(directoryname, outputprefix, result.modelamount);
+	results.push_back(result);
+	return true;
+}
+
+int benchmark(string directoryname, vector<string> settingstrings, unsigned int threadamount){
+	/*
+	Generates a pair of synthetic stages in <directory>, times each extract and merge mode on them, and prints the results as JSON.
+	*/
+	SyntheticStageSettings settings;
+	uint32_t runamount = 3;
+	for (string& settingstring : settingstrings){
+		size_t equals = settingstring.find('=');
+		string settingname = settingstring.substr(0, equals);
+		uint32_t settingvalue = (equals == string::npos) ? 0 : strtoul(settingstring.c_str() + equals + 1, nullptr, 0);
+		if (settingname == "models"){
+			settings.modelamount = max(4u, settingvalue);
+		} else if (settingname == "namelength"){
+			settings.namelength = settingvalue;
+		} else if (settingname == "materials"){
+			settings.materialamount = settingvalue;
+		} else if (settingname == "textures"){
+			settings.textureamount = settingvalue;
+		} else if (settingname == "texturesize"){
+			settings.texturelength = settingvalue;
+		} else if (settingname == "modelsize"){
+			settings.modellength = settingvalue;
+		} else if (settingname == "runs"){
+			runamount = max(1u, settingvalue);
+		} else {
+			cerr << "Unknown benchmark setting " << settingstring << "!" << endl;
+			return -1;
+		}
+	}
+	if (settings.textureamount == 0){
+		//every material uses a texture, so a stage without any can't have materials either
+		settings.materialamount = 0;
+	}
+	error_code directoryerror;
+	filesystem::create_directories(directoryname, directoryerror);
+	string stage1 = (filesystem::path(directoryname) / "bench1").string();
+	string stage2 = (filesystem::path(directoryname) / "bench2").string();
+	if (writeSyntheticStage(stage1, settings, 0x1234567) == false || writeSyntheticStage(stage2, settings, 0x7654321) == false){
+		cerr << "Couldn't write the synthetic stages to " << directoryname << "!" << endl;
+		return -1;
+	}
+	string middlemodel = "MODEL_" + to_string(settings.modelamount/2 + ((settings.modelamount/2) % 10 == 3 ? 1 : 0));
+	middlemodel.append(settings.namelength > middlemodel.length() ? settings.namelength - middlemodel.length() : 0, 'X');
+	QuietHost host;
+	vector<BenchmarkResult> results;
+	bool issuccessful = runBenchmark(results, "goal_extract", directoryname, "bench1_", runamount, [&](){
+		return modelExtract(host, stage1, 1, "", threadamount, "");
+	}) && runBenchmark(results, "switch_extract", directoryname, "bench1_", runamount, [&](){
+		return modelExtract(host, stage1, 2, "", threadamount, "");
+	}) && runBenchmark(results, "model_extract", directoryname, "bench1_", runamount, [&](){
+		return modelExtract(host, stage1, 3, middlemodel, threadamount, "");
+	}) && runBenchmark(results, "batch_extract", directoryname, "bench1_", runamount, [&](){
+		return batchExtract(host, stage1, {"*"}, threadamount, "");
+	}) && runBenchmark(results, "merge", directoryname, "bench1+", runamount, [&](){
+		return gmatplMerge(host, {stage1, stage2}, stage1 + "+" + "bench2", false);
+	}) && runBenchmark(results, "merge_dedup", directoryname, "bench1+", runamount, [&](){
+		return gmatplMerge(host, {stage1, stage1}, stage1 + "+" + "bench1", true);
+	});
+	if (issuccessful == false){
+		cerr << "A benchmark failed!" << endl;
+		return -1;
+	}
+	cout << "{" << endl
+		<< "\t\"settings\": {\"models\": " << settings.modelamount << ", \"namelength\": " << settings.namelength
+		<< ", \"materials\": " << settings.materialamount << ", \"textures\": " << settings.textureamount
+		<< ", \"texturesize\": " << settings.texturelength << ", \"modelsize\": " << settings.modellength
+		<< ", \"runs\": " << runamount << ", \"threads\": " << threadamount << "}," << endl
+		<< "\t\"results\": [" << endl;
+	for (size_t resultnumber = 0; resultnumber < results.size(); resultnumber++){
+		const BenchmarkResult& result = results[resultnumber];
+		double seconds = max(result.seconds, 1e-9);
+		cout << "\t\t{\"name\": \"" << result.name << "\", \"seconds\": " << result.seconds
+			<< ", \"models\": " << result.modelamount << ", \"bytes\": " << result.outputlength
+			<< ", \"models_per_s\": " << (result.modelamount / seconds)
+			<< ", \"mb_per_s\": " << (result.outputlength / seconds / 1000000.0) << "}"
+			<< ((resultnumber+1 < results.size()) ? "," : "") << endl;
+	}
+	cout << "\t]" << endl << "}" << endl;
+	return 0;
+}
+
+/*
+
+Main body
+
+*/
+
+/*
+Swaps any inputs coming from a pipeline archive for the names of the GMA and TPL pairs inside it.
+*/
+bool expandPipelineInputs(vector<string>& filenames){
+	vector<string> expandedfilenames;
+	for (const string& filename : filenames){
+		int inputdescriptor = parseDescriptor(filename, 0);
+		if (inputdescriptor < 0){
+			expandedfilenames.push_back(filename);
+		} else if (pipelinearchive.readFrom(inputdescriptor, expandedfilenames) == false){
+			cout << "Couldn't read a pipeline archive from " << filename << "!" << endl;
+			return false;
+		}
+	}
+	filenames = expandedfilenames;
+	return true;
+}
+
+/*
+Commands that work on one stage run once for every stage in an archive.
+*/
+int forEachInput(string filename, const function<int(string)>& operation){
+	vector<string> filenames = {filename};
+	if (expandPipelineInputs(filenames) == false){
+		return -1;
+	}
+	int successval = 0;
+	for (const string& expandedfilename : filenames){
+		if (operation(expandedfilename) != 0){
+			successval = -1;
+		}
+	}
+	return successval;
+}
+
+/*
+Prints the --stats report, either as lines of text or as one JSON object.
+*/
+void printStats(Host& host, bool isjson, double walltime){
+	const pair<const char*, const atomic<uint64_t>*> counters[] = {
+		{"files opened", &runstats.filesopened}, {"bytes mapped", &runstats.bytesmapped},
+		{"reads", &runstats.reads}, {"bytes read", &runstats.bytesread},
+		{"writes", &runstats.writes}, {"bytes written", &runstats.byteswritten},
+		{"kernel copies", &runstats.kernelcopies}, {"bytes copied", &runstats.bytescopied},
+		{"seeks", &runstats.seeks}
+	};
+	string report;
+	if (isjson){
+		report = "{\"wall seconds\": " + to_string(walltime) + ", \"phase seconds\": {";
+		for (int phase = 0; phase < phaseamount; phase++){
+			report += string(phase > 0 ? ", " : "") + "\"" + phasenames[phase] + "\": " + to_string(runstats.phasenanoseconds[phase] / 1e9);
+		}
+		report += "}";
+		for (auto& counter : counters){
+			report += string(", \"") + counter.first + "\": " + to_string(counter.second->load());
+		}
+		report += "}";
+	} else {
+		report = "Wall time: " + to_string(walltime) + "s";
+		for (int phase = 0; phase < phaseamount; phase++){
+			report += string("\n") + phasenames[phase] + ": " + to_string(runstats.phasenanoseconds[phase] / 1e9) + "s";
+		}
+		for (auto& counter : counters){
+			report += string("\n") + counter.first + ": " + to_string(counter.second->load());
+		}
+	}
+	host.message(report);
+}
+
+int main(int argc, char* argv[]){
+	int successval = 1;
+	ConsoleHost host;
+	//options go before the operation
+	unsigned int threadamount = 1;
+	bool deduplicate = false;
+	string combinedsuffix;
+	int statsformat = 0; //0 is off, 1 is text and 2 is JSON
+	int argumentpointer = 1;
+	while (argumentpointer < argc){
+		string option(argv[argumentpointer]);
+		if (option == "-j" && argumentpointer+1 < argc){
+			//-j 0 uses every core
+			threadamount = atoi(argv[argumentpointer+1]);
+			if (threadamount == 0){
+				threadamount = max(1u, thread::hardware_concurrency());
+			}
+			argumentpointer += 2;
+		} else if (option == "-dedup"){
+			deduplicate = true;
+			argumentpointer += 1;
+		} else if (option == "-c" && argumentpointer+1 < argc){
+			combinedsuffix = argv[argumentpointer+1];
+			argumentpointer += 2;
+		} else if (option == "--stats" || option == "--stats=json"){
+			statsformat = (option == "--stats") ? 1 : 2;
+			runstats.istiming = true;
+			argumentpointer += 1;
+		} else if (option == "-o" && argumentpointer+1 < argc){
+			int outputdescriptor = parseDescriptor(argv[argumentpointer+1], 1);
+			if (outputdescriptor < 0){
+				cout << "Pipeline output has to be \"-\" or \"fd:<number>\"!" << endl;
+				return -1;
+			}
+			#ifdef _WIN32
+			_setmode(outputdescriptor, _O_BINARY);
+			#endif
+			if (outputdescriptor == 1){
+				//the archive has stdout to itself, so messages go to stderr instead
+				cout.rdbuf(cerr.rdbuf());
+			}
+			pipelinearchive.writeTo(outputdescriptor);
+			argumentpointer += 2;
+		} else {
+			break;
+		}
+	}
+	vector<string> arguments(argv+argumentpointer, argv+argc);
+	chrono::steady_clock::time_point starttime = chrono::steady_clock::now();
+	if (arguments.size() >= 2) {
+		string operationtype = arguments[0];
+		if (operationtype == "-be" && arguments.size() >= 3) {
+			vector<string> selections(arguments.begin()+2, arguments.end());
+			successval = forEachInput(arguments[1], [&](string filename){
+				return batchExtract(host, filename, selections, threadamount, combinedsuffix);
+			});
+		} else if (operationtype == "-m" && (arguments.size() >= 3 || parseDescriptor(arguments[1], 0) >= 0)) {
+			//the output is named after every input, joined with +
+			vector<string> filenames(arguments.begin()+1, arguments.end());
+			if (expandPipelineInputs(filenames) == false){
+				return -1;
+			}
+			if (filenames.empty()){
+				cout << "There's nothing to merge!" << endl;
+				return -1;
+			}
+			string outputname = filenames[0];
+			for (size_t inputnumber = 1; inputnumber < filenames.size(); inputnumber++){
+				outputname += "+" + filenames[inputnumber];
+			}
+			successval = gmatplMerge(host, filenames, outputname, deduplicate);
+		} else if (operationtype == "-mo" && arguments.size() >= 3) {
+			string outputname = arguments[1];
+			vector<string> filenames(arguments.begin()+2, arguments.end());
+			if (expandPipelineInputs(filenames) == false){
+				return -1;
+			}
+			if (filenames.empty()){
+				cout << "There's nothing to merge!" << endl;
+				return -1;
+			}
+			successval = gmatplMerge(host, filenames, outputname, deduplicate);
+		} else if (operationtype == "-a" && arguments.size() >= 3) {
+			if (pipelinearchive.isWriting()){
+				cout << "Appending changes the target in place, so it can't be used with -o!" << endl;
+				return -1;
+			}
+			string targetname = arguments[1];
+			vector<string> filenames(arguments.begin()+2, arguments.end());
+			if (expandPipelineInputs(filenames) == false){
+				return -1;
+			}
+			successval = gmatplAppend(host, targetname, filenames, deduplicate);
+		} else if (operationtype == "-shard" && arguments.size() >= 3) {
+			vector<string> shardspecs(arguments.begin()+2, arguments.end());
+			successval = forEachInput(arguments[1], [&](string filename){
+				return shardSplit(host, filename, shardspecs);
+			});
+		} else if (operationtype == "-index" && arguments.size() >= 3) {
+			string indexname = arguments[1];
+			successval = buildAssetIndex(host, indexname, vector<string>(arguments.begin()+2, arguments.end()), threadamount);
+		} else if ((operationtype == "-query" || operationtype == "-qe") && arguments.size() >= 3) {
+			string indexname = arguments[1];
+			successval = queryAssetIndex(host, indexname, vector<string>(arguments.begin()+2, arguments.end()), operationtype == "-qe", threadamount, combinedsuffix);
+		} else if (operationtype == "-w" && arguments.size() >= 3) {
+			if (pipelinearchive.isWriting()){
+				cout << "Watch mode never finishes, so it can't be used with -o!" << endl;
+				return -1;
+			}
+			vector<string> selections(arguments.begin()+2, arguments.end());
+			successval = watchDirectory(host, arguments[1], selections, threadamount, combinedsuffix);
+		} else if (operationtype == "-v") {
+			vector<string> filenames(arguments.begin()+1, arguments.end());
+			if (expandPipelineInputs(filenames) == false){
+				return -1;
+			}
+			successval = verifyStages(host, filenames, threadamount);
+		} else if (operationtype == "-bench") {
+			string directoryname = arguments[1];
+			//nothing else goes to the console, so the JSON can be piped straight into something else
+			return benchmark(directoryname, vector<string>(arguments.begin()+2, arguments.end()), threadamount);
+		} else if (arguments.size() == 2) {
+			if (operationtype == "-ge") {
+				successval = forEachInput(arguments[1], [&](string filename){
+					return modelExtract(host, filename, 1, "", threadamount, combinedsuffix);
+				});
+			} else if (operationtype == "-se"){
+				successval = forEachInput(arguments[1], [&](string filename){
+					return modelExtract(host, filename, 2, "", threadamount, combinedsuffix);
+				});
+			} else if (operationtype == "-dge"){
+				string directoryname = arguments[1];
+				successval = directoryExtract(host, directoryname, 1, threadamount, combinedsuffix);
+			} else if (operationtype == "-dse"){
+				string directoryname = arguments[1];
+				successval = directoryExtract(host, directoryname, 2, threadamount, combinedsuffix);
+			}
+		} else if (arguments.size() == 3) {
+			if (operationtype == "-me") {
+				string specificmodelname = arguments[2];
+				successval = forEachInput(arguments[1], [&](string filename){
+					return modelExtract(host, filename, 3, specificmodelname, threadamount, combinedsuffix);
+				});
+			} else {successval = helpText();}
+		} else {successval = helpText();}
+	} else {successval = helpText();}
+	if (statsformat > 0){
+		printStats(host, statsformat == 2, chrono::duration<double>(chrono::steady_clock::now() - starttime).count());
+	}
+	if (successval == 0){
+		cout << endl << "Done!";
+	}
+	return successval;
+}